@@ -4,32 +4,598 @@
 
 #include <cassert>
 #include "ChessBoardState.h"
+#include "LinePattern.h"
+#include "Random.h"
 #include <iostream>
 #include "glog/logging.h"
-#include <random>
+#include <algorithm>
+#include <cstdlib>
 
 namespace gomoku {
 
-    uint64_t ChessBoardState::hash() const {
-        uint64_t h = 0;
-        for (int i = 0; i < BOARD_SIZE; i++) {
-            for (int j = 0; j < BOARD_SIZE; j++) {
-                h = h * 3 + static_cast<uint64_t>(board[i][j]);
+    namespace {
+        template<int BOARD_SIZE>
+        struct ZobristTable {
+            uint64_t low[2][BOARD_SIZE * BOARD_SIZE];
+            uint64_t high[2][BOARD_SIZE * BOARD_SIZE];
+            //transformed[color][cell]是该格子经8种对称变换后那一格的low，落子/悔棋时连续8次异或进symmetry_keys
+            uint64_t transformed[2][BOARD_SIZE * BOARD_SIZE][8];
+        };
+
+        //对称变换作用后的格子编号，约定见ChessBoardStateT::SYMMETRY_NUM
+        constexpr int SymmetryCell(int transform, int board_size, int x, int y) {
+            if (transform & 4) {
+                const int t = x;
+                x = y;
+                y = t;
+            }
+            if (transform & 1) {
+                x = board_size - 1 - x;
+            }
+            if (transform & 2) {
+                y = board_size - 1 - y;
+            }
+            return x * board_size + y;
+        }
+
+        //变换的复合：compose[a][b]为先做b再做a，拿一个不在任何对称轴上的点逐个比对得到
+        struct SymmetryTable {
+            int compose[8][8];
+            int inverse[8];
+        };
+
+        constexpr SymmetryTable MakeSymmetryTable() {
+            SymmetryTable table{};
+            for (int a = 0; a < 8; a++) {
+                for (int b = 0; b < 8; b++) {
+                    const int cell = SymmetryCell(b, 5, 0, 1);
+                    const int target = SymmetryCell(a, 5, cell / 5, cell % 5);
+                    for (int t = 0; t < 8; t++) {
+                        if (SymmetryCell(t, 5, 0, 1) == target) {
+                            table.compose[a][b] = t;
+                        }
+                    }
+                    if (table.compose[a][b] == 0) {
+                        table.inverse[a] = b;
+                    }
+                }
+            }
+            return table;
+        }
+
+        constexpr SymmetryTable kSymmetry = MakeSymmetryTable();
+
+        //low、high每格都是独立的随机数，对称局面的hash()由transformed逐格维护，不从low推导，否则轨道上的键相关会引入结构性碰撞
+        template<int BOARD_SIZE>
+        constexpr ZobristTable<BOARD_SIZE> MakeZobristTable() {
+            ZobristTable<BOARD_SIZE> table{};
+            uint64_t state = 20240105;
+            for (int color = 0; color < 2; color++) {
+                for (int i = 0; i < BOARD_SIZE * BOARD_SIZE; i++) {
+                    table.high[color][i] = SplitMix64(&state);
+                    table.low[color][i] = SplitMix64(&state);
+                }
+            }
+            for (int color = 0; color < 2; color++) {
+                for (int i = 0; i < BOARD_SIZE * BOARD_SIZE; i++) {
+                    for (int t = 0; t < 8; t++) {
+                        table.transformed[color][i][t] =
+                                table.low[color][SymmetryCell(t, BOARD_SIZE, i / BOARD_SIZE, i % BOARD_SIZE)];
+                    }
+                }
+            }
+            return table;
+        }
+
+        //编译期生成，避免静态初始化顺序问题
+        template<int BOARD_SIZE>
+        constexpr ZobristTable<BOARD_SIZE> kZobrist = MakeZobristTable<BOARD_SIZE>();
+
+        //每条线上不属于棋盘的格子（两端的补位以及对角线两端棋盘外的部分）：border是线型编码里的边界位，
+        //blocked是同样的格子按一格一位、线上第k格在第k+LINE_PAD位排列，供线型表挡住己方棋子
+        template<int BOARD_SIZE>
+        struct LineBorderTable {
+            uint64_t border[6 * BOARD_SIZE - 2];
+            uint64_t blocked[6 * BOARD_SIZE - 2];
+        };
+
+        template<int BOARD_SIZE, int LINE_PAD>
+        constexpr LineBorderTable<BOARD_SIZE> MakeLineBorderTable() {
+            LineBorderTable<BOARD_SIZE> table{};
+            for (int line = 0; line < 6 * BOARD_SIZE - 2; line++) {
+                //线上格子的范围[begin, end]：行列是整条线，对角线按LineIndex反推纵坐标的范围
+                int begin = 0, end = BOARD_SIZE - 1;
+                if (line >= 4 * BOARD_SIZE - 1) {
+                    const int sum = line - (4 * BOARD_SIZE - 1); // x + y
+                    begin = sum - BOARD_SIZE + 1 > 0 ? sum - BOARD_SIZE + 1 : 0;
+                    end = sum < BOARD_SIZE - 1 ? sum : BOARD_SIZE - 1;
+                } else if (line >= 2 * BOARD_SIZE) {
+                    const int diff = line - 2 * BOARD_SIZE - (BOARD_SIZE - 1); // x - y
+                    begin = -diff > 0 ? -diff : 0;
+                    end = BOARD_SIZE - 1 - diff < BOARD_SIZE - 1 ? BOARD_SIZE - 1 - diff : BOARD_SIZE - 1;
+                }
+                for (int k = -LINE_PAD; k < BOARD_SIZE + LINE_PAD; k++) {
+                    if (k < begin || k > end) {
+                        table.border[line] |= 3ULL << (2 * (k + LINE_PAD));
+                        table.blocked[line] |= 1ULL << (k + LINE_PAD);
+                    }
+                }
+            }
+            return table;
+        }
+
+        template<int BOARD_SIZE, int LINE_PAD>
+        constexpr LineBorderTable<BOARD_SIZE> kLineBorder = MakeLineBorderTable<BOARD_SIZE, LINE_PAD>();
+
+        //把低32位的每一位展开到相邻两位中的低位：第k位移到第2k位
+        inline uint64_t SpreadBits(uint32_t bits) {
+            uint64_t x = bits;
+            x = (x | x << 16) & 0x0000FFFF0000FFFFULL;
+            x = (x | x << 8) & 0x00FF00FF00FF00FFULL;
+            x = (x | x << 4) & 0x0F0F0F0F0F0F0F0FULL;
+            x = (x | x << 2) & 0x3333333333333333ULL;
+            x = (x | x << 1) & 0x5555555555555555ULL;
+            return x;
+        }
+
+        //以第LINE_PAD位为中心的窗口去掉中心位，得到线型表下标的一半，见LinePattern
+        inline uint32_t DropCenter(uint64_t window) {
+            const uint32_t mask = (1u << LinePattern::WINDOW_RADIUS) - 1;
+            return static_cast<uint32_t>((window & mask) |
+                                         ((window >> (LinePattern::WINDOW_RADIUS + 1)) & mask)
+                                                 << LinePattern::WINDOW_RADIUS);
+        }
+
+        //禁手预筛：以第5位为中心、左右各5格的黑子窗口，CROWDED_PAIR表示左右4格内至少两个黑子，
+        //CROWDED_LINE表示左右4格内至少四个黑子或左右5格内至少五个黑子
+        enum : uint8_t {
+            CROWDED_PAIR = 1, CROWDED_LINE = 2
+        };
+
+        struct CrowdTable {
+            uint8_t value[1 << 11];
+        };
+
+        constexpr CrowdTable MakeCrowdTable() {
+            CrowdTable table{};
+            for (int window = 0; window < (1 << 11); window++) {
+                int near = 0;
+                for (int k = 1; k <= 9; k++) {
+                    near += (window >> k) & 1;
+                }
+                const int far = near + (window & 1) + ((window >> 10) & 1);
+                table.value[window] = static_cast<uint8_t>((near >= 2 ? CROWDED_PAIR : 0) |
+                                                           (near >= 4 || far >= 5 ? CROWDED_LINE : 0));
+            }
+            return table;
+        }
+
+        constexpr CrowdTable kCrowd = MakeCrowdTable();
+
+        //按位并行的全加器，每一位独立地把a、b、c相加
+        inline void FullAdd(uint64_t a, uint64_t b, uint64_t c, uint64_t *sum, uint64_t *carry) {
+            *sum = a ^ b ^ c;
+            *carry = (a & b) | (c & (a ^ b));
+        }
+
+        //线上LinePos加一时坐标的变化，与LineIndex的约定一致
+        const int kLineStep[4][2] = {{0,  1},
+                                     {1,  0},
+                                     {1,  1},
+                                     {-1, 1}};
+
+        //把一行的棋子位图扩张到相隔distance行的候选位图：同行取左右1、2格，隔1行取左中右，隔2行取左2、中、右2
+        inline uint32_t NearMask(uint32_t occupied, int distance) {
+            switch (distance) {
+                case 0:
+                    return (occupied << 1) | (occupied >> 1) | (occupied << 2) | (occupied >> 2);
+                case 1:
+                    return occupied | (occupied << 1) | (occupied >> 1);
+                default:
+                    return occupied | (occupied << 2) | (occupied >> 2);
+            }
+        }
+    }
+
+    template<int BOARD_SIZE>
+    int ChessBoardStateT<BOARD_SIZE>::LineIndex(int dir, int x, int y) {
+        switch (dir) {
+            case 0:
+                return x;
+            case 1:
+                return BOARD_SIZE + y;
+            case 2:
+                return 2 * BOARD_SIZE + x - y + BOARD_SIZE - 1;
+            default:
+                return 4 * BOARD_SIZE - 1 + x + y;
+        }
+    }
+
+    template<int BOARD_SIZE>
+    int ChessBoardStateT<BOARD_SIZE>::LinePos(int dir, int x, int y) {
+        return dir == 1 ? x : y;
+    }
+
+    template<int BOARD_SIZE>
+    uint64_t ChessBoardStateT<BOARD_SIZE>::GetLineCode(int line) const {
+        assert(0 <= line && line < LINE_NUM);
+        const uint64_t stones = SpreadBits(lines[0][line]) * LINE_BLACK | SpreadBits(lines[1][line]) * LINE_WHITE;
+        return stones << (2 * LINE_PAD) | kLineBorder<BOARD_SIZE, LINE_PAD>.border[line];
+    }
+
+    template<int BOARD_SIZE>
+    uint16_t ChessBoardStateT<BOARD_SIZE>::LookupPattern(int color, int dir, int x, int y,
+                                                         const Cell *extra, int extra_num) const {
+        static_assert(LINE_PAD == LinePattern::WINDOW_RADIUS, "pattern window must fit in line padding");
+        const int line = LineIndex(dir, x, y), pos = LinePos(dir, x, y);
+        uint64_t own = lines[color][line];
+        for (int i = 0; i < extra_num; i++) {
+            const int ex = extra[i] / BOARD_SIZE, ey = extra[i] % BOARD_SIZE;
+            if (LineIndex(dir, ex, ey) == line) {
+                own |= 1ULL << LinePos(dir, ex, ey);
+            }
+        }
+        const uint64_t blocked = (static_cast<uint64_t>(lines[1 - color][line]) << LINE_PAD) |
+                                 kLineBorder<BOARD_SIZE, LINE_PAD>.blocked[line];
+        //禁手规则下的黑棋要求恰好五连
+        return LinePattern::Lookup(DropCenter((own << LINE_PAD) >> pos), DropCenter(blocked >> pos),
+                                   color == 0 && rule_set == RENJU);
+    }
+
+    template<int BOARD_SIZE>
+    void ChessBoardStateT<BOARD_SIZE>::SetRuleSet(RuleSet rule) {
+        rule_set = rule;
+        if (tracked_types) {
+            RebuildThreats(); //黑棋是否要求恰好五连变了
+        }
+    }
+
+    template<int BOARD_SIZE>
+    void ChessBoardStateT<BOARD_SIZE>::LineCellAt(int line, int pos, int *x, int *y) {
+        *y = pos;
+        if (line < BOARD_SIZE) {
+            *x = line;
+        } else if (line < 2 * BOARD_SIZE) {
+            *x = pos;
+            *y = line - BOARD_SIZE;
+        } else if (line < 4 * BOARD_SIZE - 1) {
+            *x = line - (3 * BOARD_SIZE - 1) + pos;
+        } else {
+            *x = line - (4 * BOARD_SIZE - 1) - pos;
+        }
+    }
+
+    template<int BOARD_SIZE>
+    void ChessBoardStateT<BOARD_SIZE>::UpdateThreatLine(int line) {
+        //两种颜色拼在一个uint64里同时算：低32位是黑棋，高32位是白棋。右移会把白棋的位移进低半边的高位，
+        //但每个窗口都要与上己方可用的格子，这些位都会被清掉
+        const uint64_t valid = (~kLineBorder<BOARD_SIZE, LINE_PAD>.blocked[line] >> LINE_PAD) & FULL_LINE;
+        const uint64_t empty = (valid & ~static_cast<uint64_t>(lines[0][line] | lines[1][line])) * 0x100000001ULL;
+        const uint64_t own = lines[0][line] | static_cast<uint64_t>(lines[1][line]) << 32;
+        const uint64_t free = own | empty;
+        //第s位对应从格子s开始的窗口：五格窗口里没有对方棋子和边界，己方棋子数为four*4+two*2+one
+        const uint64_t window = free & free >> 1 & free >> 2 & free >> 3 & free >> 4;
+        uint64_t sum, carry, one, carry2;
+        FullAdd(own, own >> 1, own >> 2, &sum, &carry);
+        FullAdd(sum, own >> 3, own >> 4, &one, &carry2);
+        const uint64_t two = carry ^ carry2, four = carry & carry2;
+        //禁手规则下黑棋要恰好五连，窗口两侧都不能再有黑子
+        const uint64_t exact = rule_set == RENJU ? 0xFFFFFFFFULL : 0;
+        uint64_t five_start = window & four & ~two & ~one;
+        five_start &= ~((own << 1 | own >> 5) & exact);
+        uint64_t masks[THREAT_TYPE_NUM] = {
+                (five_start | five_start << 1 | five_start << 2 | five_start << 3 | five_start << 4) & empty
+        };
+        if (tracked_types > THREAT_FOUR) {
+            uint64_t four_start = window & ~four & two & one;
+            //活三：格子s和s+5是空点，中间四格没有对方棋子且恰有两个己方棋子，再补两子就是活四
+            FullAdd(own >> 1, own >> 2, own >> 3, &sum, &carry);
+            const uint64_t middle = free >> 1 & free >> 2 & free >> 3 & free >> 4;
+            uint64_t three_start = empty & empty >> 5 & middle & ~(sum ^ own >> 4) & (carry ^ (sum & own >> 4));
+            four_start &= ~((own << 1 | own >> 5) & exact);
+            three_start &= ~((own << 1 | own >> 6) & exact);
+            masks[THREAT_FOUR] = (four_start | four_start << 1 | four_start << 2 | four_start << 3 |
+                                  four_start << 4) & empty;
+            masks[THREAT_THREE] = (three_start << 1 | three_start << 2 | three_start << 3 | three_start << 4) & empty;
+        }
+        const int shift = line & 63;
+        for (int type = 0; type < tracked_types; type++) {
+            for (int color = 0; color < 2; color++) {
+                const uint32_t mask = static_cast<uint32_t>(masks[type] >> (32 * color));
+                threat_table->threats[color][type][line] = static_cast<LineMask>(mask);
+                uint64_t &word = threat_table->threat_lines[color][type][line >> 6];
+                word = (word & ~(1ULL << shift)) | static_cast<uint64_t>(mask != 0) << shift;
+            }
+        }
+    }
+
+    template<int BOARD_SIZE>
+    void ChessBoardStateT<BOARD_SIZE>::UpdateThreats(int x, int y, int placed) {
+        for (int dir = 0; dir < 4; dir++) {
+            const int line = LineIndex(dir, x, y);
+            //只跟踪成五点时：落子前这条线上没有成五点，落子左右四格内己方又不到四子，落子后也不会有，不用重算。
+            //随机模拟中大多数落子都能这样跳过
+            if (placed >= 0 && tracked_types == THREAT_FIVE + 1 &&
+                !threat_table->threats[0][THREAT_FIVE][line] && !threat_table->threats[1][THREAT_FIVE][line] &&
+                __builtin_popcount(lines[placed][line] & (0x1FFu << LinePos(dir, x, y) >> 4)) < 4) {
+                continue;
+            }
+            UpdateThreatLine(line);
+        }
+    }
+
+    template<int BOARD_SIZE>
+    void ChessBoardStateT<BOARD_SIZE>::RebuildThreats() {
+        for (int line = 0; line < LINE_NUM; line++) {
+            UpdateThreatLine(line);
+        }
+    }
+
+    template<int BOARD_SIZE>
+    void ChessBoardStateT<BOARD_SIZE>::SetThreatTracking(bool enable, ThreatType max_type) {
+        tracked_types = enable ? max_type + 1 : 0;
+        if (enable) {
+            if (!threat_table) {
+                threat_table.reset(new ThreatTable());
+            }
+            RebuildThreats();
+        } else {
+            threat_table.reset();
+        }
+    }
+
+    template<int BOARD_SIZE>
+    bool ChessBoardStateT<BOARD_SIZE>::HasThreat(bool is_black, ThreatType type) const {
+        assert(type < tracked_types);
+        const uint64_t *words = threat_table->threat_lines[ColorIndex(is_black)][type];
+        for (int i = 0; i < LINE_WORDS; i++) {
+            if (words[i]) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    template<int BOARD_SIZE>
+    ChessMove ChessBoardStateT<BOARD_SIZE>::GetThreatMove(bool is_black, ThreatType type) const {
+        assert(type < tracked_types);
+        const int color = ColorIndex(is_black);
+        for (int i = 0; i < LINE_WORDS; i++) {
+            if (threat_table->threat_lines[color][type][i]) {
+                const int line = i * 64 + __builtin_ctzll(threat_table->threat_lines[color][type][i]);
+                int x, y;
+                LineCellAt(line, __builtin_ctz(threat_table->threats[color][type][line]), &x, &y);
+                return {is_black, x, y};
+            }
+        }
+        return ChessMove();
+    }
+
+    template<int BOARD_SIZE>
+    int ChessBoardStateT<BOARD_SIZE>::GetThreatMoves(bool is_black, ThreatType type,
+                                                     std::vector<ChessMove> *moves) const {
+        assert(type < tracked_types);
+        //同一个点可能在几条线上都是威胁点，先按行汇总再输出
+        const int color = ColorIndex(is_black);
+        uint32_t rows[BOARD_SIZE]{};
+        for (int i = 0; i < LINE_WORDS; i++) {
+            uint64_t word = threat_table->threat_lines[color][type][i];
+            while (word) {
+                const int line = i * 64 + __builtin_ctzll(word);
+                word &= word - 1;
+                uint32_t mask = threat_table->threats[color][type][line];
+                while (mask) {
+                    int x, y;
+                    LineCellAt(line, __builtin_ctz(mask), &x, &y);
+                    mask &= mask - 1;
+                    rows[x] |= 1u << y;
+                }
+            }
+        }
+        int num = 0;
+        for (int x = 0; x < BOARD_SIZE; x++) {
+            while (rows[x]) {
+                moves->emplace_back(is_black, x, __builtin_ctz(rows[x]));
+                rows[x] &= rows[x] - 1;
+                num++;
+            }
+        }
+        return num;
+    }
+
+    template<int BOARD_SIZE>
+    bool ChessBoardStateT<BOARD_SIZE>::IsThreatPoint(bool is_black, ThreatType type, int x, int y) const {
+        assert(type < tracked_types);
+        const int color = ColorIndex(is_black);
+        for (int dir = 0; dir < 4; dir++) {
+            if ((threat_table->threats[color][type][LineIndex(dir, x, y)] >> LinePos(dir, x, y)) & 1) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    template<int BOARD_SIZE>
+    bool ChessBoardStateT<BOARD_SIZE>::IsForbidden(int x, int y) const {
+        if (rule_set != RENJU || GetChessAt(x, y) != EMPTY) {
+            return false;
+        }
+        //禁手至少要两个方向上各有两个黑子（三三、四四），或者一个方向上左右4格内有四个黑子（同一条线上的四四），
+        //或者左右5格内有五个黑子（长连），绝大多数空点到这里就排除了。四个方向都查完再判断，避免分支预测失败
+        int pairs = 0, crowded = 0;
+        for (int dir = 0; dir < 4; dir++) {
+            const uint64_t window = (static_cast<uint64_t>(lines[0][LineIndex(dir, x, y)]) << LINE_PAD) >>
+                                    LinePos(dir, x, y);
+            const int flags = kCrowd.value[window & 0x7FF];
+            pairs += flags & CROWDED_PAIR;
+            crowded |= flags;
+        }
+        if (pairs < 2 && !(crowded & CROWDED_LINE)) {
+            return false;
+        }
+        return IsForbiddenWith(x, y, nullptr, 0);
+    }
+
+    template<int BOARD_SIZE>
+    bool ChessBoardStateT<BOARD_SIZE>::IsForbiddenWith(int x, int y, const Cell *extra, int extra_num) const {
+        uint16_t patterns[4];
+        int fours = 0, threes = 0;
+        bool overline = false;
+        for (int dir = 0; dir < 4; dir++) {
+            patterns[dir] = LookupPattern(0, dir, x, y, extra, extra_num);
+            if (patterns[dir] & LinePattern::FIVE) {
+                return false;
+            }
+            overline |= (patterns[dir] & LinePattern::OVERLINE) != 0;
+            fours += LinePattern::FourCount(patterns[dir]);
+            threes += (patterns[dir] & LinePattern::OPEN_THREE) != 0;
+        }
+        if (overline || fours >= 2) {
+            return true;
+        }
+        if (threes < 2 || extra_num >= FORBIDDEN_DEPTH) {
+            return false;
+        }
+        //活三要能变成活四才算数：在(x,y)落子后，至少有一个活三点不是禁手
+        Cell next[FORBIDDEN_DEPTH + 1];
+        std::copy(extra, extra + extra_num, next);
+        next[extra_num] = static_cast<Cell>(x * BOARD_SIZE + y);
+        int real_threes = 0;
+        for (int dir = 0; dir < 4; dir++) {
+            uint32_t points = LinePattern::ThreePoints(patterns[dir]);
+            while (points) {
+                const int offset = LinePattern::ThreePointOffset(__builtin_ctz(points));
+                points &= points - 1;
+                if (!IsForbiddenWith(x + offset * kLineStep[dir][0], y + offset * kLineStep[dir][1],
+                                     next, extra_num + 1)) {
+                    real_threes++;
+                    break;
+                }
             }
         }
-        return h;
+        return real_threes >= 2;
     }
 
-    Chess ChessBoardState::GetChessAt(int x, int y) const {
-        assert(x < BOARD_SIZE);
-        assert(y < BOARD_SIZE);
-        return board[x][y];
+    template<int BOARD_SIZE>
+    void ChessBoardStateT<BOARD_SIZE>::SwapSlot(int slot1, int slot2) {
+        std::swap(cells[slot1], cells[slot2]);
+        cell_slot[cells[slot1]] = static_cast<Cell>(slot1);
+        cell_slot[cells[slot2]] = static_cast<Cell>(slot2);
     }
 
-    ChessBoardState::ChessBoardState(const std::vector<ChessMove> &moves) : is_end(0), is_init(true) {
+    template<int BOARD_SIZE>
+    ChessMove ChessBoardStateT<BOARD_SIZE>::TransformMove(int transform, ChessMove move) {
+        assert(0 <= transform && transform < SYMMETRY_NUM);
+        const int cell = SymmetryCell(transform, BOARD_SIZE, move.x, move.y);
+        return {move.is_black, cell / BOARD_SIZE, cell % BOARD_SIZE};
+    }
+
+    template<int BOARD_SIZE>
+    ChessMove ChessBoardStateT<BOARD_SIZE>::InverseTransformMove(int transform, ChessMove move) {
+        assert(0 <= transform && transform < SYMMETRY_NUM);
+        return TransformMove(kSymmetry.inverse[transform], move);
+    }
+
+    template<int BOARD_SIZE>
+    uint64_t ChessBoardStateT<BOARD_SIZE>::SymmetryHash(int transform) const {
+        assert(0 <= transform && transform < SYMMETRY_NUM);
+        return symmetry_keys[transform];
+    }
+
+    template<int BOARD_SIZE>
+    uint64_t ChessBoardStateT<BOARD_SIZE>::CanonicalHash(int *transform) const {
+        uint64_t key = zobrist_key.low;
+        int best = 0;
+        for (int t = 1; t < SYMMETRY_NUM; t++) {
+            const uint64_t symmetry_key = SymmetryHash(t);
+            if (symmetry_key < key) {
+                key = symmetry_key;
+                best = t;
+            }
+        }
+        if (transform != nullptr) {
+            *transform = best;
+        }
+        return key;
+    }
+
+    template<int BOARD_SIZE>
+    void ChessBoardStateT<BOARD_SIZE>::ToggleSymmetryKeys(int color, int cell) {
+        //第t个键加上变换后那一格的键
+        const uint64_t *keys = kZobrist<BOARD_SIZE>.transformed[color][cell];
+        for (int t = 0; t < SYMMETRY_NUM; t++) {
+            symmetry_keys[t] ^= keys[t];
+        }
+    }
+
+    template<int BOARD_SIZE>
+    void ChessBoardStateT<BOARD_SIZE>::SetStone(int color, int x, int y) {
+        //先换到空点段末尾，空点段缩短后它就成了黑子段的第一个；白子还要再和黑子段最后一个交换
+        int empty_num = EmptyNum();
+        SwapSlot(cell_slot[x * BOARD_SIZE + y], empty_num - 1);
+        if (color == 0) {
+            black_num++;
+        } else {
+            SwapSlot(empty_num - 1, empty_num - 1 + black_num);
+        }
+        for (int dir = 0; dir < 4; dir++) {
+            lines[color][LineIndex(dir, x, y)] |= static_cast<LineMask>(1u << LinePos(dir, x, y));
+        }
+        zobrist_key.low ^= kZobrist<BOARD_SIZE>.low[color][x * BOARD_SIZE + y];
+        zobrist_key.high ^= kZobrist<BOARD_SIZE>.high[color][x * BOARD_SIZE + y];
+        ToggleSymmetryKeys(color, x * BOARD_SIZE + y);
+        //新棋子只会增加候选点，直接把它的邻域或到上下两行以内的位图上（near_rows有上下两行哨兵，不用判断边界）
+        const uint32_t bit = 1u << y;
+        near_rows[x] |= static_cast<LineMask>(NearMask(bit, 2));
+        near_rows[x + 1] |= static_cast<LineMask>(NearMask(bit, 1));
+        near_rows[x + 2] |= static_cast<LineMask>(NearMask(bit, 0));
+        near_rows[x + 3] |= static_cast<LineMask>(NearMask(bit, 1));
+        near_rows[x + 4] |= static_cast<LineMask>(NearMask(bit, 2));
+        if (tracked_types) {
+            UpdateThreats(x, y, color);
+        }
+    }
+
+    template<int BOARD_SIZE>
+    void ChessBoardStateT<BOARD_SIZE>::ClearStone(int color, int x, int y) {
+        //SetStone的逆过程，调用方随后把history.size减一，空点段扩展一格把它包含进来
+        int empty_num = EmptyNum();
+        if (color == 0) {
+            SwapSlot(cell_slot[x * BOARD_SIZE + y], empty_num);
+            black_num--;
+        } else {
+            SwapSlot(cell_slot[x * BOARD_SIZE + y], empty_num + black_num);
+            SwapSlot(empty_num + black_num, empty_num);
+        }
+        for (int dir = 0; dir < 4; dir++) {
+            lines[color][LineIndex(dir, x, y)] &= static_cast<LineMask>(~(1u << LinePos(dir, x, y)));
+        }
+        zobrist_key.low ^= kZobrist<BOARD_SIZE>.low[color][x * BOARD_SIZE + y];
+        zobrist_key.high ^= kZobrist<BOARD_SIZE>.high[color][x * BOARD_SIZE + y];
+        ToggleSymmetryKeys(color, x * BOARD_SIZE + y);
+        //移除棋子后受影响的只有上下两行以内，按占位位图重新扩张这几行
+        for (int row = std::max(x - 2, 0); row <= std::min(x + 2, BOARD_SIZE - 1); row++) {
+            uint32_t near = 0;
+            for (int i = std::max(row - 2, 0); i <= std::min(row + 2, BOARD_SIZE - 1); i++) {
+                near |= NearMask(lines[0][i] | lines[1][i], std::abs(row - i));
+            }
+            near_rows[row + 2] = static_cast<LineMask>(near);
+        }
+        if (tracked_types) {
+            UpdateThreats(x, y, -1);
+        }
+    }
+
+    template<int BOARD_SIZE>
+    ChessBoardStateT<BOARD_SIZE>::ChessBoardStateT(const std::vector<ChessMove> &moves) : is_end(0), is_init(true),
+                                                                                       rule_set(FREESTYLE),
+                                                                                       tracked_types(0) {
         ClearBoard();
         for (auto &move: moves) {
-            assert(ChessBoardState::Move(move));
+            //Move必须在NDEBUG下也执行，不能放在assert里
+            bool ok = Move(move);
+            assert(ok);
+            (void)ok;
         }
     }
 
@@ -50,250 +616,214 @@ namespace gomoku {
 //        return true;
 //    }
 
-    bool ChessBoardState::Move(ChessMove move) {
+    template<int BOARD_SIZE>
+    bool ChessBoardStateT<BOARD_SIZE>::Move(ChessMove move) {
+        return Push(move);
+    }
+
+    template<int BOARD_SIZE>
+    bool ChessBoardStateT<BOARD_SIZE>::Push(ChessMove move) {
         assert(0 <= move.x && move.x < BOARD_SIZE);
         assert(0 <= move.y && move.y < BOARD_SIZE);
-        auto &chess = board[move.x][move.y];
-        if (chess != EMPTY) {
+        if (GetChessAt(move.x, move.y) != EMPTY) {
             LOG(ERROR) << "move failed, move: " << move;
             return false;
         }
-        is_init = false;
         assert(is_end == 0);
-        chess = move.is_black ? BLACK : WHITE;
+        history[history.size] = {static_cast<Cell>(move.x * BOARD_SIZE + move.y), move.is_black,
+                             static_cast<int8_t>(is_end), is_init};
+        is_init = false;
+        SetStone(ColorIndex(move.is_black), move.x, move.y);
         update_is_end_from(move.x, move.y);
-        move_num++;
+        history.size++;
         return true;
     }
 
+    template<int BOARD_SIZE>
+    ChessMove ChessBoardStateT<BOARD_SIZE>::Pop() {
+        assert(history.size > 0);
+        const MoveRecord record = history[history.size - 1];
+        ChessMove move(record.is_black, record.cell / BOARD_SIZE, record.cell % BOARD_SIZE);
+        ClearStone(ColorIndex(record.is_black), move.x, move.y);
+        is_end = record.is_end;
+        is_init = record.is_init;
+        history.size--;
+        return move;
+    }
 
-    int ChessBoardState::IsEnd() const {
-        return is_end;
+    template<int BOARD_SIZE>
+    void ChessBoardStateT<BOARD_SIZE>::UndoTo(int ply) {
+        assert(0 <= ply && ply <= history.size);
+        while (history.size > ply) {
+            Pop();
+        }
     }
 
-    bool ChessBoardState::IsEmpty() {
-        for (int i = 0; i < BOARD_SIZE; i++) {
-            for (int j = 0; j < BOARD_SIZE; j++) {
-                if (board[i][j] != EMPTY)return false;
-            }
+    template<int BOARD_SIZE>
+    ChessMove ChessBoardStateT<BOARD_SIZE>::GetLastMove() const {
+        if (history.size == 0) {
+            return ChessMove();
         }
-        return true;
+        const MoveRecord &record = history[history.size - 1];
+        return {record.is_black, record.cell / BOARD_SIZE, record.cell % BOARD_SIZE};
     }
 
-    void ChessBoardState::ClearBoard() {
-        for (int i = 0; i < BOARD_SIZE; i++) {
-            for (int j = 0; j < BOARD_SIZE; j++) {
-                board[i][j] = EMPTY;
-            }
+    template<int BOARD_SIZE>
+    int ChessBoardStateT<BOARD_SIZE>::IsEnd() const {
+        return is_end;
+    }
+
+    template<int BOARD_SIZE>
+    bool ChessBoardStateT<BOARD_SIZE>::IsEmpty() {
+        return history.size == 0;
+    }
+
+    template<int BOARD_SIZE>
+    void ChessBoardStateT<BOARD_SIZE>::ClearBoard() {
+        lines = {};
+        zobrist_key = ZobristKey128{};
+        symmetry_keys = {};
+        for (int i = 0; i < BOARD_SIZE * BOARD_SIZE; i++) {
+            cells[i] = static_cast<Cell>(i);
+            cell_slot[i] = static_cast<Cell>(i);
+        }
+        black_num = 0;
+        near_rows = {};
+        //空棋盘上没有威胁点
+        if (threat_table) {
+            *threat_table = ThreatTable{};
         }
         is_end = 0;
         is_init = true;
-        move_num = 0;
+        history.size = 0;
     }
 
-    ChessBoardState::ChessBoardState() : is_end(0), is_init(true), move_num(0) {
-        for (int i = 0; i < BOARD_SIZE; i++) {
-            for (int j = 0; j < BOARD_SIZE; j++) {
-                board[i][j] = EMPTY;
-            }
-        }
+    template<int BOARD_SIZE>
+    ChessBoardStateT<BOARD_SIZE>::ChessBoardStateT() : is_end(0), is_init(true), rule_set(FREESTYLE),
+                                                       tracked_types(0) {
+        ClearBoard();
     }
 
-    bool ChessBoardState::WithdrawMove(ChessMove move) {
+    template<int BOARD_SIZE>
+    bool ChessBoardStateT<BOARD_SIZE>::WithdrawMove(ChessMove move) {
         Chess chess = move.is_black ? BLACK : WHITE;
-        if (board[move.x][move.y] != chess) {
+        if (GetChessAt(move.x, move.y) != chess) {
             return false;
         }
-        board[move.x][move.y] = EMPTY;
+        if (GetLastMove() == move) {
+            Pop();
+            return true;
+        }
+        const Cell cell = static_cast<Cell>(move.x * BOARD_SIZE + move.y);
+        auto record = std::find_if(history.records, history.records + history.size,
+                                   [cell](const MoveRecord &r) -> bool { return r.cell == cell; });
+        std::copy(record + 1, history.records + history.size, record);
+        ClearStone(ColorIndex(move.is_black), move.x, move.y);
         if (is_end) {
             is_end = 0;
         }
-        move_num--;
+        history.size--;
         return true;
     }
 
-    void ChessBoardState::update_is_end_from(int x, int y) {
-        assert(board[x][y] != EMPTY);
-//        int dir[8][2] = {{1,  0},
-//                         {-1, 0},
-//                         {0,  1},
-//                         {0,  -1},
-//                         {1,  1},
-//                         {-1, -1},
-//                         {1,  -1},
-//                         {-1, 1}};
-        int cnt[8] = {0};
-        const int board_size = static_cast<int>(BOARD_SIZE - 1);
-        //0
-        {
-            int i = x, j = y;
-            int dx = 1, dy = 0;
-            int max_step = board_size - i;
-            while (max_step-- > 0 &&
-                   board[i + dx][j + dy] == board[x][y]) {
-                i += dx;
-                j += dy;
-                cnt[0]++;
-                if (cnt[0] >= 4) {
-                    is_end = board[x][y] == BLACK ? 1 : -1;
-                    return;
-                }
-            }
-        }
-        //1
-        {
-            int i = x, j = y;
-            int dx = -1, dy = 0;
-            int max_step = i;
-            while (max_step-- > 0 &&
-                   board[i + dx][j + dy] == board[x][y]) {
-                i += dx;
-                j += dy;
-                cnt[1]++;
-                if (cnt[1] + cnt[0] >= 4) {
-                    is_end = board[x][y] == BLACK ? 1 : -1;
-                    return;
-                }
-            }
-        }
-        //2
-        {
-            int i = x, j = y;
-            int dx = 0, dy = 1;
-            int max_step = board_size - j;
-            while (max_step-- > 0 &&
-                   board[i + dx][j + dy] == board[x][y]) {
-                i += dx;
-                j += dy;
-                cnt[2]++;
-                if (cnt[2] >= 4) {
-                    is_end = board[x][y] == BLACK ? 1 : -1;
-                    return;
-                }
-            }
+    template<int BOARD_SIZE>
+    void ChessBoardStateT<BOARD_SIZE>::update_is_end_from(int x, int y) {
+        assert(GetChessAt(x, y) != EMPTY);
+        //落子前局面未结束，新出现的五连必然经过(x,y)，只需检查经过该点的四条线
+        if (IsWinMove({HasStone(0, x, y), x, y})) {
+            is_end = HasStone(0, x, y) ? 1 : -1;
         }
-        //3
-        {
-            int i = x, j = y;
-            int dx = 0, dy = -1;
-            int max_step = j;
-            while (max_step-- > 0 &&
-                   board[i + dx][j + dy] == board[x][y]) {
-                i += dx;
-                j += dy;
-                cnt[3]++;
-                if (cnt[3] + cnt[2] >= 4) {
-                    is_end = board[x][y] == BLACK ? 1 : -1;
-                    return;
-                }
-            }
-        }
-        //4
-        {
-            int i = x, j = y;
-            int dx = 1, dy = 1;
-            int max_step = std::min(board_size - i, board_size - j);
-            while (max_step-- > 0 &&
-                   board[i + dx][j + dy] == board[x][y]) {
-                i += dx;
-                j += dy;
-                cnt[4]++;
-                if (cnt[4] >= 4) {
-                    is_end = board[x][y] == BLACK ? 1 : -1;
-                    return;
-                }
-            }
-        }
-        //5
-        {
-            int i = x, j = y;
-            int dx = -1, dy = -1;
-            int max_step = std::min(i, j);
-            while (max_step-- > 0 &&
-                   board[i + dx][j + dy] == board[x][y]) {
-                i += dx;
-                j += dy;
-                cnt[5]++;
-                if (cnt[5] + cnt[4] >= 4) {
-                    is_end = board[x][y] == BLACK ? 1 : -1;
-                    return;
-                }
-            }
+    }
+
+    template<int BOARD_SIZE>
+    bool ChessBoardStateT<BOARD_SIZE>::IsWinMove(const ChessMove &move) const {
+        if (rule_set == RENJU && move.is_black) {
+            return IsExactFiveMove(move.x, move.y);
         }
-        //6
-        {
-            int i = x, j = y;
-            int dx = 1, dy = -1;
-            int max_step = std::min(board_size - i, j);
-            while (max_step-- > 0 &&
-                   board[i + dx][j + dy] == board[x][y]) {
-                i += dx;
-                j += dy;
-                cnt[6]++;
-                if (cnt[6] >= 4) {
-                    is_end = board[x][y] == BLACK ? 1 : -1;
-                    return;
-                }
+        const int color = ColorIndex(move.is_black);
+        for (int dir = 0; dir < 4; dir++) {
+            uint32_t line = lines[color][LineIndex(dir, move.x, move.y)] | (1u << LinePos(dir, move.x, move.y));
+            // line & line>>1 标记连续2子的起点，再与自身>>2得到连续4子，最后与line>>4得到连续5子
+            uint32_t m = line & (line >> 1);
+            m &= m >> 2;
+            if (m & (line >> 4)) {
+                return true;
             }
         }
-        //7
-        {
-            int i = x, j = y;
-            int dx = -1, dy = 1;
-            int max_step = std::min(i, board_size - j);
-            while (max_step-- > 0 &&
-                   board[i + dx][j + dy] == board[x][y]) {
-                i += dx;
-                j += dy;
-                cnt[7]++;
-                if (cnt[7] + cnt[6] >= 4) {
-                    is_end = board[x][y] == BLACK ? 1 : -1;
-                    return;
-                }
+        return false;
+    }
+
+    template<int BOARD_SIZE>
+    bool ChessBoardStateT<BOARD_SIZE>::IsExactFiveMove(int x, int y) const {
+        for (int dir = 0; dir < 4; dir++) {
+            const int pos = LinePos(dir, x, y);
+            const uint32_t line = lines[0][LineIndex(dir, x, y)] | (1u << pos);
+            //pos所在连子的两端：往上数连续的1，往下找最高的0
+            const int end = pos + __builtin_ctz(~(line >> pos));
+            const uint32_t below = ~line & ((1u << pos) - 1);
+            const int begin = below ? 32 - __builtin_clz(below) : 0;
+            if (end - begin == 5) {
+                return true;
             }
         }
+        return false;
     }
 
-    void ChessBoardState::GetMoves(bool is_black, std::vector<ChessMove> *moves) const {
+    template<int BOARD_SIZE>
+    void ChessBoardStateT<BOARD_SIZE>::GetMoves(bool is_black, std::vector<ChessMove> *moves) const {
         assert(is_end == 0);
+        const bool check_forbidden = is_black && rule_set == RENJU;
         moves->reserve(BOARD_SIZE * BOARD_SIZE);
         for (int i = 0; i < BOARD_SIZE; i++) {
-            for (int j = 0; j < BOARD_SIZE; j++) {
-                if (board[i][j] == EMPTY) {
-                    moves->emplace_back(is_black, i, j);
+            uint32_t empty = ~static_cast<uint32_t>(lines[0][i] | lines[1][i]) & FULL_LINE;
+            while (empty) {
+                const int y = __builtin_ctz(empty);
+                empty &= empty - 1;
+                if (!check_forbidden || !IsForbidden(i, y)) {
+                    moves->emplace_back(is_black, i, y);
                 }
             }
         }
     }
 
-    void ChessBoardState::GetPositionVec(std::vector<std::pair<int, int>> *black_pos,
+    template<int BOARD_SIZE>
+    void ChessBoardStateT<BOARD_SIZE>::GetPositionVec(std::vector<std::pair<int, int>> *black_pos,
                                          std::vector<std::pair<int, int>> *white_pos) const {
-        for (int i = 0; i < BOARD_SIZE; i++) {
-            for (int j = 0; j < BOARD_SIZE; j++) {
-                if (board[i][j] == BLACK) {
-                    black_pos->push_back(std::make_pair(i, j));
-                } else if (board[i][j] == WHITE) {
-                    white_pos->push_back(std::make_pair(i, j));
-                }
+        for (int i = 0; i < history.size; i++) {
+            int x, y;
+            if (GetStone(i, &x, &y) == BLACK) {
+                black_pos->push_back(std::make_pair(x, y));
+            } else {
+                white_pos->push_back(std::make_pair(x, y));
             }
         }
     }
 
-    void ChessBoardState::GetPositionMap(std::map<std::pair<int, int>, Chess> *pos2chess) const {
-        for (int i = 0; i < BOARD_SIZE; i++) {
-            for (int j = 0; j < BOARD_SIZE; j++) {
-                if (board[i][j] != EMPTY) {
-                    pos2chess->emplace(std::make_pair(i, j), board[i][j]);
-                }
-            }
+    template<int BOARD_SIZE>
+    void ChessBoardStateT<BOARD_SIZE>::GetPositionMap(std::map<std::pair<int, int>, Chess> *pos2chess) const {
+        for (int i = 0; i < history.size; i++) {
+            int x, y;
+            Chess chess = GetStone(i, &x, &y);
+            pos2chess->emplace(std::make_pair(x, y), chess);
         }
     }
 
-    void ChessBoardState::PrintOnTerminal() {
+    template<int BOARD_SIZE>
+    Chess ChessBoardStateT<BOARD_SIZE>::GetStone(int index, int *x, int *y) const {
+        assert(0 <= index && index < history.size);
+        int cell = cells[EmptyNum() + index];
+        *x = cell / BOARD_SIZE;
+        *y = cell % BOARD_SIZE;
+        return index < black_num ? BLACK : WHITE;
+    }
+
+    template<int BOARD_SIZE>
+    void ChessBoardStateT<BOARD_SIZE>::PrintOnTerminal() {
         std::cout << *this;
     }
 
-    std::ostream &operator<<(std::ostream &os, const ChessBoardState &state) {
+    template<int BOARD_SIZE>
+    std::ostream &operator<<(std::ostream &os, const ChessBoardStateT<BOARD_SIZE> &state) {
         os << std::endl;
         os << "  ";
         for (int i = 0; i < BOARD_SIZE; i++) {
@@ -304,7 +834,7 @@ namespace gomoku {
             os << i << " ";
             for (int j = 0; j < BOARD_SIZE; j++) {
                 char c;
-                switch (state.board[i][j]) {
+                switch (state.GetChessAt(i, j)) {
                     case EMPTY:
                         c = '*';
                         break;
@@ -325,38 +855,35 @@ namespace gomoku {
         return os;
     }
 
-    bool ChessBoardState::isInit() const {
+    template<int BOARD_SIZE>
+    bool ChessBoardStateT<BOARD_SIZE>::isInit() const {
         return is_init;
     }
 
-    ChessMove ChessBoardState::getRandMove(bool is_black) {
-        std::random_device rd;
-        std::mt19937 gen(rd());
-        std::uniform_int_distribution<int> dist(0, BOARD_SIZE - 1);
-        int try_num = BOARD_SIZE;
-        while (try_num--) {
-            int x = dist(gen);
-            int y = dist(gen);
-            if (GetChessAt(x, y) == Chess::EMPTY) {
-                return {is_black, x, y};
-            }
+    template<int BOARD_SIZE>
+    ChessMove ChessBoardStateT<BOARD_SIZE>::getRandMove(bool is_black) {
+        auto &rng = ThreadRandom();
+        int empty_num = EmptyNum();
+        if (empty_num == 0) {
+            return ChessMove();
         }
-        std::vector<ChessMove> moves;
-        for (int i = 0; i < BOARD_SIZE; i++) {
-            for (int j = 0; j < BOARD_SIZE; j++) {
-                if (GetChessAt(i, j) == Chess::EMPTY) {
-                    moves.emplace_back(is_black, i, j);
-                }
-            }
+        ChessMove move = GetNthMove(is_black, static_cast<int>(rng.Below(empty_num)));
+        if (!is_black || rule_set != RENJU || !IsForbidden(move.x, move.y)) {
+            return move;
         }
-        if (moves.empty()) {
-            return ChessMove();
+        //禁手点很少，从随机位置开始顺序找第一个不是禁手的空点；全是禁手时返回ChessMove()
+        const int start = static_cast<int>(rng.Below(empty_num));
+        for (int i = 0; i < empty_num; i++) {
+            move = GetNthMove(is_black, (start + i) % empty_num);
+            if (!IsForbidden(move.x, move.y)) {
+                return move;
+            }
         }
-        std::uniform_int_distribution<int> dist2(0, moves.size() - 1);
-        return moves[dist2(gen)];
+        return ChessMove();
     }
 
-    BoardResult ChessBoardState::End() const {
+    template<int BOARD_SIZE>
+    BoardResult ChessBoardStateT<BOARD_SIZE>::End() const {
         switch (is_end) {
             case 0:
                 return BoardResult::NOT_END;
@@ -369,62 +896,62 @@ namespace gomoku {
         }
     }
 
-    int ChessBoardState::GetMoveNums() const {
-        return move_num;
+    template<int BOARD_SIZE>
+    int ChessBoardStateT<BOARD_SIZE>::GetMoveNums() const {
+        return history.size;
+    }
+
+    template<int BOARD_SIZE>
+    ChessMove ChessBoardStateT<BOARD_SIZE>::GetNthMove(bool is_black, int index) {
+        assert(0 <= index && index < EmptyNum());
+        return {is_black, cells[index] / BOARD_SIZE, cells[index] % BOARD_SIZE};
     }
 
-    ChessMove ChessBoardState::GetNthMove(bool is_black, int index) {
-        int cnt = 0;
+    template<int BOARD_SIZE>
+    bool ChessBoardStateT<BOARD_SIZE>::IsCutMove(const ChessMove &move) const {
+        return !((near_rows[move.x + 2] >> move.y) & 1);
+    }
+
+    template<int BOARD_SIZE>
+    int ChessBoardStateT<BOARD_SIZE>::GetCandidateMoves(bool is_black, ChessMove *moves) const {
+        const bool check_forbidden = is_black && rule_set == RENJU;
+        int num = 0;
         for (int i = 0; i < BOARD_SIZE; i++) {
-            for (int j = 0; j < BOARD_SIZE; j++) {
-                if (GetChessAt(i, j) == Chess::EMPTY) {
-                    if (cnt++ == index) {
-                        return {is_black, i, j};
-                    }
+            uint32_t candidate = near_rows[i + 2] & ~static_cast<uint32_t>(lines[0][i] | lines[1][i]) & FULL_LINE;
+            while (candidate) {
+                const int y = __builtin_ctz(candidate);
+                candidate &= candidate - 1;
+                if (!check_forbidden || !IsForbidden(i, y)) {
+                    moves[num++] = {is_black, i, y};
                 }
             }
         }
-        assert(false);
-    }
-
-    bool ChessBoardState::IsCutMove(const ChessMove &move) const {
-        const int &x = move.x;
-        const int &y = move.y;
-
-        // 上
-        if (x - 1 >= 0 && board[x - 1][y] != Chess::EMPTY) return false;
-        // 下
-        if (x + 1 < BOARD_SIZE && board[x + 1][y] != Chess::EMPTY) return false;
-        // 左
-        if (y - 1 >= 0 && board[x][y - 1] != Chess::EMPTY) return false;
-        // 右
-        if (y + 1 < BOARD_SIZE && board[x][y + 1] != Chess::EMPTY) return false;
-        // 左上
-        if (x - 1 >= 0 && y - 1 >= 0 && board[x - 1][y - 1] != Chess::EMPTY) return false;
-        // 右上
-        if (x - 1 >= 0 && y + 1 < BOARD_SIZE && board[x - 1][y + 1] != Chess::EMPTY) return false;
-        // 左下
-        if (x + 1 < BOARD_SIZE && y - 1 >= 0 && board[x + 1][y - 1] != Chess::EMPTY) return false;
-        // 右下
-        if (x + 1 < BOARD_SIZE && y + 1 < BOARD_SIZE && board[x + 1][y + 1] != Chess::EMPTY) return false;
-
-        // 上
-        if (x - 2 >= 0 && board[x - 2][y] != Chess::EMPTY) return false;
-        // 下
-        if (x + 2 < BOARD_SIZE && board[x + 2][y] != Chess::EMPTY) return false;
-        // 左
-        if (y - 2 >= 0 && board[x][y - 2] != Chess::EMPTY) return false;
-        // 右
-        if (y + 2 < BOARD_SIZE && board[x][y + 2] != Chess::EMPTY) return false;
-        // 左上
-        if (x - 2 >= 0 && y - 2 >= 0 && board[x - 2][y - 2] != Chess::EMPTY) return false;
-        // 右上
-        if (x - 2 >= 0 && y + 2 < BOARD_SIZE && board[x - 2][y + 2] != Chess::EMPTY) return false;
-        // 左下
-        if (x + 2 < BOARD_SIZE && y - 2 >= 0 && board[x + 2][y - 2] != Chess::EMPTY) return false;
-        // 右下
-        if (x + 2 < BOARD_SIZE && y + 2 < BOARD_SIZE && board[x + 2][y + 2] != Chess::EMPTY) return false;
+        return num;
+    }
+
+    template
+    class ChessBoardStateT<15>;
+
+    template
+    class ChessBoardStateT<19>;
 
+    template
+    class ChessBoardStateT<20>;
+
+    template std::ostream &operator<<(std::ostream &os, const ChessBoardStateT<15> &state);
+
+    template std::ostream &operator<<(std::ostream &os, const ChessBoardStateT<19> &state);
+
+    template std::ostream &operator<<(std::ostream &os, const ChessBoardStateT<20> &state);
+
+    bool ParseRuleSet(const std::string &name, RuleSet *rule_set) {
+        if (name == "freestyle") {
+            *rule_set = FREESTYLE;
+        } else if (name == "renju") {
+            *rule_set = RENJU;
+        } else {
+            return false;
+        }
         return true;
     }
 
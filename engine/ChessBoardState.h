@@ -2,9 +2,15 @@
 // Created by zrr on 2024/1/5.
 //
 #include <stdint.h>
+#include <cassert>
 #include <vector>
+#include <algorithm>
+#include <array>
 #include <map>
+#include <memory>
 #include <ostream>
+#include <type_traits>
+#include <string>
 
 #ifndef GOMOKU_CHESSBOARDSTATE_H
 #define GOMOKU_CHESSBOARDSTATE_H
@@ -20,7 +26,20 @@ enum BoardResult {
     NOT_END = 3,
 };
 namespace gomoku {
-    const int BOARD_SIZE = 15;
+    const int BOARD_SIZE = 15; //默认棋盘大小，其余支持的大小见 WithBoardSize
+
+    /**
+     * FREESTYLE：五连及以上即获胜；RENJU：黑棋只有恰好五连才获胜，且不能下三三、四四、长连禁手，白棋不受限制
+     */
+    enum RuleSet {
+        FREESTYLE = 0,
+        RENJU = 1
+    };
+
+    /**
+     * 解析规则名freestyle/renju，不认识时返回false
+     */
+    bool ParseRuleSet(const std::string &name, RuleSet *rule_set);
 
     struct ChessMove {
         bool is_black;
@@ -38,39 +57,267 @@ namespace gomoku {
 
     };
 
-    class ChessBoardState {
+    /**
+     * 128位的局面哈希，供不能容忍64位碰撞的表使用
+     */
+    struct ZobristKey128 {
+        uint64_t low, high;
+
+        bool operator==(const ZobristKey128 &rhs) const {
+            return low == rhs.low && high == rhs.high;
+        }
+
+        bool operator!=(const ZobristKey128 &rhs) const {
+            return !(rhs == *this);
+        }
+
+        bool operator<(const ZobristKey128 &rhs) const {
+            return high != rhs.high ? high < rhs.high : low < rhs.low;
+        }
+    };
+
+    struct ZobristKey128Hash {
+        size_t operator()(const ZobristKey128 &key) const { return key.low; }
+    };
+
+    /**
+     * 棋盘大小是编译期常量，所有循环都是定长的；常用的15、19、20在gomoku_lib中显式实例化
+     */
+    template<int BOARD_SIZE>
+    class ChessBoardStateT {
     private:
         int is_end;
         bool is_init;
-        int move_num;
+        RuleSet rule_set;
     public:
         bool isInit() const;
 
         void setIsInit(bool isInit);
 
+        // 线的编号：行、列各BOARD_SIZE条，两种对角线各2*BOARD_SIZE-1条，按LineIndex平铺，
+        // 线上第LinePos个格子对应(x,y)。行上的第k格对应(x,k)，列上的第k格对应(k,y)，两种对角线上的第k格都对应纵坐标y=k的格子
+        static const int LINE_NUM = 6 * BOARD_SIZE - 2;
+
+        static int LineIndex(int dir, int x, int y); //dir: 0行 1列 2主对角线 3副对角线
+        static int LinePos(int dir, int x, int y);
+
+        // 线型编码：每条线一个uint64，每格2位，线上第k格在第2*(k+LINE_PAD)位；两端各补LINE_PAD个边界格，
+        // 对角线上落在棋盘外的格子也记为边界，取任意一格附近的窗口都不用判断越界。
+        // 编码由两种颜色的线位图交织得到，位图本身在落子/悔棋时每次只改4条线
+        enum LineCell {
+            LINE_EMPTY = 0, LINE_BLACK = 1, LINE_WHITE = 2, LINE_BORDER = 3
+        };
+        static const int LINE_PAD = 5;
+
+        // 棋盘的8种对称变换：变换t先在t&4时沿主对角线转置，再在t&1时上下翻转、t&2时左右翻转，0为恒等变换
+        static const int SYMMETRY_NUM = 8;
+
+        static ChessMove TransformMove(int transform, ChessMove move);
+
+        static ChessMove InverseTransformMove(int transform, ChessMove move);
+
+        // 威胁点：在该空点落子后，THREAT_FIVE成五，THREAT_FOUR成四（再下一子能成五），THREAT_THREE成活三（再下一子能成活四）。
+        // 只看棋型：禁手规则下黑棋按恰好五连算，但不排除禁手点
+        enum ThreatType {
+            THREAT_FIVE = 0, THREAT_FOUR = 1, THREAT_THREE = 2
+        };
+        static const int THREAT_TYPE_NUM = 3;
+
     private:
-        Chess board[BOARD_SIZE][BOARD_SIZE]{};
+        // 位棋盘：每种颜色按行、列、主对角线、副对角线四个方向各存一份位图，四份位图在Move/WithdrawMove中同步更新。
+        // 所有方向的线按 LineIndex 平铺在同一个数组里，行位图同时也是该颜色的占位位图，线上第k格对应第k位。
+        using LineMask = typename std::conditional<BOARD_SIZE <= 16, uint16_t, uint32_t>::type;
+        static_assert(BOARD_SIZE <= 32, "LineMask is too narrow for BOARD_SIZE");
+        static const LineMask FULL_LINE = static_cast<LineMask>((1u << BOARD_SIZE) - 1);
+        std::array<std::array<LineMask, LINE_NUM>, 2> lines{};
+        ZobristKey128 zobrist_key{}; //low即为hash()，在SetStone/ClearStone中增量维护
+        // 8种对称局面各自的hash()，在SetStone/ClearStone中增量维护，symmetry_keys[0]即hash()
+        std::array<uint64_t, SYMMETRY_NUM> symmetry_keys{};
+        static_assert(2 * (BOARD_SIZE + 2 * LINE_PAD) <= 64, "line code does not fit in uint64_t");
+
+        // 格子编号为x*BOARD_SIZE+y。cells是所有格子的一个排列，分成三段：[0,empty_num)为空点，
+        // 接着black_num个黑子，其余为白子；cell_slot记录每个格子在cells中的下标，落子/悔棋都只需O(1)次交换
+        using Cell = typename std::conditional<BOARD_SIZE * BOARD_SIZE <= 256, uint8_t, uint16_t>::type;
+        std::array<Cell, BOARD_SIZE * BOARD_SIZE> cells;
+        std::array<Cell, BOARD_SIZE * BOARD_SIZE> cell_slot;
+        int black_num;
+
+        int EmptyNum() const { return BOARD_SIZE * BOARD_SIZE - history.size; }
+
+        // 候选点：经过该点的四条线上距离不超过2的16个格子里有棋子。near_rows按行记录候选点位图，
+        // 落子时或上新棋子的邻域，悔棋时重算上下两行以内，IsCutMove只需一次位测试。
+        // 第x行存在near_rows[x+2]，上下各留两行哨兵，超出棋盘的位在读取时屏蔽
+        std::array<LineMask, BOARD_SIZE + 4> near_rows;
+
+        void SwapSlot(int slot1, int slot2);
+
+        // 落子栈：按顺序记录每一步的格子、颜色以及落子前的is_end/is_init，栈深度即history.size。
+        // 其余增量状态（位图、哈希、空点表、候选点）都能由格子和颜色逆推，Pop时O(1)精确还原
+        struct MoveRecord {
+            Cell cell;
+            bool is_black;
+            int8_t is_end;
+            bool is_init;
+        };
+        // 拷贝时只拷前size个，MCTS每轮复制根局面时不用带上栈里没用到的部分
+        struct MoveStack {
+            int size = 0; //即已经落下的棋子数
+            MoveRecord records[BOARD_SIZE * BOARD_SIZE];
+
+            MoveStack() = default;
+
+            MoveStack(const MoveStack &other) : size(other.size) {
+                std::copy(other.records, other.records + size, records);
+            }
+
+            MoveStack &operator=(const MoveStack &other) {
+                size = other.size;
+                std::copy(other.records, other.records + size, records);
+                return *this;
+            }
+
+            MoveRecord &operator[](int i) { return records[i]; }
+
+            const MoveRecord &operator[](int i) const { return records[i]; }
+        };
+        MoveStack history;
+
+        // 威胁点跟踪：threats按线记录每种颜色每类威胁点的位图，落子/悔棋时只重算经过该点的四条线，每条线几十次位运算；
+        // threat_lines记录位图非空的线，判断有没有威胁点、取一个威胁点都是O(1)。默认关闭，打开时整盘重算一次。
+        // 只维护前tracked_types类，0表示关闭
+        static const int LINE_WORDS = (LINE_NUM + 63) / 64;
+        struct ThreatTable {
+            LineMask threats[2][THREAT_TYPE_NUM][LINE_NUM];
+            uint64_t threat_lines[2][THREAT_TYPE_NUM][LINE_WORDS];
+        };
+
+        // ThreatTable比棋盘其余部分还大，只在打开跟踪时单独分配，关闭跟踪的棋盘拷贝时不用带上它。
+        // 拷贝时深拷贝，目标已有ThreatTable时复用，MCTS线程每轮把根局面赋值给自己的棋盘不会反复分配
+        // 有了它棋盘的拷贝不再是平凡的，裸数组成员会被逐个元素拷贝，因此其余数组成员都用std::array，仍按整块拷贝
+        struct ThreatTablePtr : std::unique_ptr<ThreatTable> {
+            ThreatTablePtr() = default;
+
+            ThreatTablePtr(const ThreatTablePtr &other)
+                    : std::unique_ptr<ThreatTable>(other ? new ThreatTable(*other) : nullptr) {}
+
+            ThreatTablePtr(ThreatTablePtr &&other) = default;
+
+            ThreatTablePtr &operator=(const ThreatTablePtr &other) {
+                if (!other) {
+                    this->reset();
+                } else if (this->get()) {
+                    *this->get() = *other;
+                } else {
+                    this->reset(new ThreatTable(*other));
+                }
+                return *this;
+            }
+
+            ThreatTablePtr &operator=(ThreatTablePtr &&other) = default;
+        };
+
+        int tracked_types;
+        ThreatTablePtr threat_table; //tracked_types为0时为空
+
+        void UpdateThreatLine(int line);
+
+        void UpdateThreats(int x, int y, int placed); //placed是刚落下的棋子的颜色，移除棋子时为-1
+
+        void RebuildThreats();
+
+        static void LineCellAt(int line, int pos, int *x, int *y); //LineIndex/LinePos的逆
+
+        static int ColorIndex(bool is_black) { return is_black ? 0 : 1; }
+
+        bool HasStone(int color, int x, int y) const { return (lines[color][x] >> y) & 1; }
+
+        void SetStone(int color, int x, int y);
+
+        void ClearStone(int color, int x, int y);
+
+        void ToggleSymmetryKeys(int color, int cell); //落子/移除棋子时更新symmetry_keys
 
         void update_is_end_from(int x, int y); //以某个点为中心判断游戏是否结束。
+
+        bool IsExactFiveMove(int x, int y) const; //黑棋在(x,y)落子后是否恰好五连
+
+        // 禁手判断：extra是判断过程中假设已经落下的黑子，三三需要递归确认活三点本身不是禁手，递归深度不超过FORBIDDEN_DEPTH
+        static const int FORBIDDEN_DEPTH = 6;
+
+        uint16_t LookupPattern(int color, int dir, int x, int y, const Cell *extra, int extra_num) const;
+
+        bool IsForbiddenWith(int x, int y, const Cell *extra, int extra_num) const;
     public:
-        ChessBoardState();
+        ChessBoardStateT();
 
-        explicit ChessBoardState(const std::vector<ChessMove> &moves);
+        explicit ChessBoardStateT(const std::vector<ChessMove> &moves);
 
-        friend std::ostream &operator<<(std::ostream &os, const ChessBoardState &state);
+        /**
+         * 局面的Zobrist哈希，O(1)
+         */
+        uint64_t hash() const { return zobrist_key.low; }
 
-        uint64_t hash() const;
+        ZobristKey128 hash128() const { return zobrist_key; }
+
+        /**
+         * 把每个棋子经TransformMove(transform, ·)变换后得到的局面的hash()，O(1)，8个值随落子增量维护
+         */
+        uint64_t SymmetryHash(int transform) const;
+
+        /**
+         * 8种对称局面的hash()中最小的一个，O(1)，互为对称的局面得到相同的值。
+         * transform不为空时写出取到最小值的变换t：当前局面的每个棋子经TransformMove(t, ·)后就是这个代表局面，
+         * 代表局面里的走法用InverseTransformMove(t, ·)换回当前局面
+         */
+        uint64_t CanonicalHash(int *transform = nullptr) const;
 
         void GetMoves(bool is_black, std::vector<ChessMove> *moves) const;
 
-        Chess GetChessAt(int x, int y) const;
+        Chess GetChessAt(int x, int y) const {
+            assert(x < BOARD_SIZE);
+            assert(y < BOARD_SIZE);
+            if (HasStone(0, x, y)) {
+                return BLACK;
+            }
+            return HasStone(1, x, y) ? WHITE : EMPTY;
+        }
 
         bool Move(ChessMove move);
 
+        /**
+         * 落子并压入落子栈，与Move相同
+         */
+        bool Push(ChessMove move);
+
+        /**
+         * 撤销最后一步，精确还原到落子前的状态（包括是否结束），返回被撤销的一步
+         */
+        ChessMove Pop();
+
+        /**
+         * 连续Pop直到只剩ply步
+         */
+        void UndoTo(int ply);
+
+        ChessMove GetLastMove() const;
+
+        /**
+         * 判断在空点落下move后是否形成五连，只检查经过该点的四条线，每条线几次位运算；禁手规则下黑棋要求恰好五连
+         */
+        bool IsWinMove(const ChessMove &move) const;
+
         int GetMoveNums() const;
 
+        /**
+         * 返回第index个空点，O(1)，空点的顺序随落子变化
+         */
         ChessMove GetNthMove(bool is_black, int index);
 
+        /**
+         * 返回第index个棋子的位置和颜色，index∈[0,GetMoveNums())，O(1)，用于按棋子遍历局面
+         */
+        Chess GetStone(int index, int *x, int *y) const;
+
         /**
      * 判断游戏是否结束,O（1）复杂度
      * @return 0代表未结束，1代表黑棋获胜，0代表白棋获胜
@@ -83,8 +330,14 @@ namespace gomoku {
 
         void ClearBoard();
 
+        /**
+         * 从空点中等概率随机选一个，O(1)，没有空点时返回ChessMove()；禁手规则下给黑棋选时跳过禁手点
+         */
         ChessMove getRandMove(bool is_black);
 
+        /**
+         * 移除一个棋子；是最后一步时等同于Pop，否则从落子栈中删除这一步并清除结束状态
+         */
         bool WithdrawMove(ChessMove move);
 
         void GetPositionVec(std::vector<std::pair<int, int>> *black_pos,
@@ -95,8 +348,89 @@ namespace gomoku {
         void PrintOnTerminal();
 
         bool IsCutMove(const ChessMove &move) const;
+
+        void SetRuleSet(RuleSet rule);
+
+        RuleSet GetRuleSet() const { return rule_set; }
+
+        /**
+         * 禁手规则下黑棋在空点(x,y)落子是否为禁手：长连、四四、三三，同时成五时不算禁手。
+         * 每个方向查一次线型表；三三要确认活三能变成的活四点本身不是禁手，只在至少两个方向成三时才递归。
+         * 无禁手规则或非空点总是false。GetMoves、GetCandidateMoves、getRandMove给黑棋的走法都已排除禁手
+         */
+        bool IsForbidden(int x, int y) const;
+
+        /**
+         * 打开/关闭威胁点跟踪。打开时按当前局面重算一次，之后每步落子/悔棋多重算四条线；不需要威胁点的随机模拟应保持关闭。
+         * 只跟踪不超过max_type的威胁点，只需要成五点时传THREAT_FIVE，每条线少算一大半
+         */
+        void SetThreatTracking(bool enable, ThreatType max_type = THREAT_THREE);
+
+        bool IsThreatTracking() const { return tracked_types > 0; }
+
+        /**
+         * is_black一方有没有type类威胁点，O(1)，需要先打开对应类型的威胁点跟踪。
+         * HasThreat(is_black, THREAT_FIVE)即能否一步获胜，HasThreat(!is_black, THREAT_FIVE)即是否必须防守
+         */
+        bool HasThreat(bool is_black, ThreatType type) const;
+
+        /**
+         * is_black一方的任意一个type类威胁点，O(1)，没有时返回ChessMove()。
+         * 对方的THREAT_FIVE点就是必须堵的点，堵之前把返回走法的颜色换成自己
+         */
+        ChessMove GetThreatMove(bool is_black, ThreatType type) const;
+
+        /**
+         * 按行优先顺序写出is_black一方所有type类威胁点，不重复，返回个数
+         */
+        int GetThreatMoves(bool is_black, ThreatType type, std::vector<ChessMove> *moves) const;
+
+        bool IsThreatPoint(bool is_black, ThreatType type, int x, int y) const;
+
+        /**
+         * 第line条线的线型编码，O(1)，格式见LineCell
+         */
+        uint64_t GetLineCode(int line) const;
+
+        /**
+         * 按行优先顺序写出所有不会被IsCutMove剪掉的空点，返回个数，moves至少要有空点数那么大
+         */
+        int GetCandidateMoves(bool is_black, ChessMove *moves) const;
     };
 
+    template<int BOARD_SIZE>
+    std::ostream &operator<<(std::ostream &os, const ChessBoardStateT<BOARD_SIZE> &state);
+
+    extern template class ChessBoardStateT<15>;
+
+    extern template class ChessBoardStateT<19>;
+
+    extern template class ChessBoardStateT<20>;
+
+    using ChessBoardState = ChessBoardStateT<BOARD_SIZE>;
+
+    /**
+     * 按运行时的棋盘大小选择对应的实例化，f以std::integral_constant<int, N>为参数调用，
+     * 在f里用decltype(size)::value取得编译期的N
+     * @return 不支持该大小时返回false
+     */
+    template<typename F>
+    bool WithBoardSize(int board_size, F &&f) {
+        switch (board_size) {
+            case 15:
+                f(std::integral_constant<int, 15>());
+                return true;
+            case 19:
+                f(std::integral_constant<int, 19>());
+                return true;
+            case 20:
+                f(std::integral_constant<int, 20>());
+                return true;
+            default:
+                return false;
+        }
+    }
+
 }
 
 #endif //GOMOKU_CHESSBOARDSTATE_H
@@ -23,7 +23,7 @@ namespace gomoku {
     Engine::SearchReturnCtx
     Engine::DFS(Engine::SearchCtx *ctx, bool is_max, int64_t upper_bound, int64_t lower_bound) {
         ctx->search_node++;
-        auto hash = ctx->board.hash();
+        auto hash = ctx->board.hash128();
         MinMaxNode this_node = std::make_pair(hash, is_max);
         if (ctx->current_depth >= ctx->depth_limit || ctx->board.IsEnd() || stop_.load()) {
             ctx->leaf_node++;
@@ -52,13 +52,11 @@ namespace gomoku {
                 moves.emplace_back(it.first);
             }
         } else {
-            std::vector<ChessMove> temp;
-            ctx->board.GetMoves(is_max, &temp);
-            for (auto &move: temp) {
-                if (IsCutMove(ctx, move)) {
-                    continue;
-                }
-                moves.emplace_back(move);
+            if (ctx->board.isInit()) {
+                ctx->board.GetMoves(is_max, &moves);
+            } else {
+                moves.resize(BOARD_SIZE * BOARD_SIZE);
+                moves.resize(ctx->board.GetCandidateMoves(is_max, moves.data()));
             }
         }
 
@@ -72,7 +70,8 @@ namespace gomoku {
               });
         for (auto it = moves.begin(); it != moves.end(); it++) {
             auto move = *it;
-            assert(ctx->board.Move(move));
+            bool ok = ctx->board.Push(move);
+            assert(ok);
             ctx->moves_.push_back(move);
             ctx->current_depth++;
             Engine::SearchReturnCtx node_result;
@@ -85,7 +84,7 @@ namespace gomoku {
             }
             ctx->current_depth--;
             ctx->moves_.pop_back();
-            assert(ctx->board.WithdrawMove(move));
+            ctx->board.Pop();
             if (is_max) {
                 if (node_result.score_ > result.score_) {
                     result = node_result;
@@ -168,8 +167,16 @@ namespace gomoku {
         if (state.IsEnd()) {
             return false;
         }
-        taskThreadPool.Start(8, 3);
-        taskThreadPool.Enqueue(std::bind(&Engine::StartSearchInternal, this, state, black_first));
+        if (pool_ == nullptr) {
+            threadPool.InitPersistent(1);
+            threadPool.Start();
+            pool_ = &threadPool;
+        }
+        search_job_ = pool_->Run(1, std::bind(&Engine::StartSearchInternal, this, state, black_first));
+        if (search_job_ == 0) {
+            LOG(ERROR) << "thread pool can not run search";
+            return false;
+        }
         return true;
     }
 
@@ -177,24 +184,27 @@ namespace gomoku {
     bool Engine::Stop() {
         stop_.store(true);
         auto start = std::chrono::high_resolution_clock::now();
-        taskThreadPool.Stop();
+        if (pool_ != nullptr) {
+            pool_->Wait(search_job_);
+        }
         auto end = std::chrono::high_resolution_clock::now();
-        LOG(INFO) << "task thread pool stop in "
+        LOG(INFO) << "search thread stop in "
                   << std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count() << " ms";
         return true;
     }
 
-    Engine::Engine() : evaluate_(nullptr), around({{1,  0},
-                                                   {-1, 0},
-                                                   {0,  1},
-                                                   {0,  -1},
-                                                   {1,  1},
-                                                   {-1, -1},
-                                                   {1,  -1},
-                                                   {-1, 1}}) {
+    Engine::Engine() : pool_(nullptr), search_job_(0), evaluate_(nullptr) {
 
     }
 
+    Engine::~Engine() {
+        Stop();
+    }
+
+    void Engine::SetThreadPool(common::ThreadPool *pool) {
+        pool_ = pool;
+    }
+
     void Engine::SetEvaluateFunction(std::function<int64_t(const ChessBoardState &)> fun) {
         evaluate_ = fun;
     }
@@ -204,25 +214,6 @@ namespace gomoku {
         return evaluate_(board);
     }
 
-    bool Engine::IsCutMove(const Engine::SearchCtx *ctx, const ChessMove &move) const {
-        //如果当前点半径为2的范围内没有棋子，则直接剪掉
-        for (auto &pos: around) {
-            if (move.x + pos.first < BOARD_SIZE && move.y + pos.second < BOARD_SIZE &&
-                ctx->board.GetChessAt(move.x + pos.first, move.y + pos.second) != Chess::EMPTY) {
-                return false;
-            }
-            if (move.x + pos.first * 2 < BOARD_SIZE && move.y + pos.second * 2 < BOARD_SIZE &&
-                ctx->board.GetChessAt(move.x + pos.first * 2, move.y + pos.second * 2) != Chess::EMPTY) {
-                return false;
-            }
-        }
-        if (ctx->board.isInit()) {
-            return false;
-        } else {
-            return true;
-        }
-    }
-
     Engine::SearchReturnCtx::SearchReturnCtx(const ChessMove &move, int64_t score, int64_t searchDepth) : search_depth_(
             searchDepth), score_(score), move_(move) {}
 
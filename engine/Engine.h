@@ -14,13 +14,14 @@
 #include "common/uncopyable.h"
 #include <atomic>
 #include <ostream>
-#include "common/task_thread_pool.h"
+#include "common/thread_pool.h"
 
 namespace gomoku {
-    using MinMaxNode=std::pair<uint64_t,bool>;
+    using MinMaxNode=std::pair<ZobristKey128,bool>; //用128位哈希作为置换表的键，避免不同局面碰撞
     class Engine {
     public:
         Engine();
+        ~Engine();
         bool StartSearch(const ChessBoardState &state, bool black_first);//非阻塞,指定先手和局面开始搜索，中断上一次的搜索
         // json GetSearchTree(int depth); //指定深度打印搜索树信息
         ChessMove GetResult(); //获取搜索结果,该函数不应该中断搜索，可以反复调用获取最新的搜索结果
@@ -28,6 +29,8 @@ namespace gomoku {
         bool Stop();
         int64_t Evaluate(const ChessBoardState &board);
         void SetEvaluateFunction(std::function<int64_t(const ChessBoardState &board)> fun);
+        //在StartSearch之前调用，搜索交给外部的常驻线程池中的一个线程，可以和MCTSEngine共用；不设置时用自己的单线程常驻池
+        void SetThreadPool(common::ThreadPool *pool);
     private:
         struct SearchCtx{
             ChessBoardState board;
@@ -49,7 +52,9 @@ namespace gomoku {
             std::string ToString() const;
         };
 
-        common::TaskThreadPool<> taskThreadPool;
+        common::ThreadPool threadPool;
+        common::ThreadPool *pool_;
+        uint64_t search_job_;
         std::mutex map_mutex_;//保护下面两个数据结构
         std::map<uint64_t ,Engine::SearchReturnCtx >depth2res_;
         std::atomic<bool> stop_;
@@ -72,8 +77,6 @@ namespace gomoku {
          * @return {走法，分值，实际搜索深度}
          */
         SearchReturnCtx DFS(SearchCtx *ctx,bool is_max,int64_t upper_bound,int64_t lower_bound);
-        bool IsCutMove(const SearchCtx *ctx,const ChessMove &move) const;
-        std::vector<std::pair<int, int >> around;
         std::map<uint64_t,int64_t> board2score;
     };
 
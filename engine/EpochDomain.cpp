@@ -0,0 +1,56 @@
+//
+// Created by zrr on 2024/3/17.
+//
+
+#include "EpochDomain.h"
+#include <thread>
+
+namespace gomoku {
+
+    EpochDomain::EpochDomain() : epoch_(1), slot_num_(0) {
+        for (auto &slot: slots_) {
+            slot.epoch.store(0, std::memory_order_relaxed);
+            slot.in_use.store(false, std::memory_order_relaxed);
+        }
+    }
+
+    EpochDomain::Slot *EpochDomain::AcquireSlot() {
+        while (true) {
+            for (int i = 0; i < MAX_READERS; i++) {
+                bool expected = false;
+                if (!slots_[i].in_use.load(std::memory_order_relaxed) &&
+                    slots_[i].in_use.compare_exchange_strong(expected, true)) {
+                    int num = slot_num_.load();
+                    while (num < i + 1 && !slot_num_.compare_exchange_weak(num, i + 1)) {
+                    }
+                    return &slots_[i];
+                }
+            }
+            std::this_thread::yield();
+        }
+    }
+
+    EpochDomain::Reader::Reader(EpochDomain *domain) : domain_(domain), slot_(domain->AcquireSlot()) {
+
+    }
+
+    EpochDomain::Reader::~Reader() {
+        slot_->epoch.store(0, std::memory_order_relaxed);
+        slot_->in_use.store(false, std::memory_order_release);
+    }
+
+    void EpochDomain::Synchronize() {
+        //之后进入的读者拿到的纪元不小于target，一定能读到替换后的指针；只需等纪元小于target的读者退出
+        uint64_t target = epoch_.fetch_add(1) + 1;
+        int num = slot_num_.load();
+        for (int i = 0; i < num; i++) {
+            while (true) {
+                uint64_t epoch = slots_[i].epoch.load();
+                if (epoch == 0 || epoch >= target) {
+                    break;
+                }
+                std::this_thread::yield();
+            }
+        }
+    }
+}
@@ -0,0 +1,87 @@
+//
+// Created by zrr on 2024/3/17.
+//
+#include <atomic>
+#include <stdint.h>
+
+#ifndef GOMOKU_EPOCHDOMAIN_H
+#define GOMOKU_EPOCHDOMAIN_H
+namespace gomoku {
+    /**
+     * 基于纪元的内存回收：读者在Enter和Exit之间读到的共享指针，写者替换后调用Synchronize，
+     * 等调用前已经进入的读者都退出了再释放旧对象。读者进出只写自己的槽位，不碰共享的引用计数和锁
+     */
+    class EpochDomain {
+        // 每个槽位占一个缓存行，epoch为0表示不在临界区，否则是进入时的纪元
+        struct Slot {
+            std::atomic<uint64_t> epoch;
+            std::atomic<bool> in_use;
+            char padding[64 - sizeof(std::atomic<uint64_t>) - sizeof(std::atomic<bool>)];
+        };
+
+    public:
+        static const int MAX_READERS = 1024;
+
+        EpochDomain();
+
+        EpochDomain(const EpochDomain &) = delete;
+
+        EpochDomain &operator=(const EpochDomain &) = delete;
+
+        /**
+         * 读者线程占用的槽位，构造时登记，析构时归还；槽位用完时等到有空闲的为止
+         */
+        class Reader {
+        public:
+            explicit Reader(EpochDomain *domain);
+
+            ~Reader();
+
+            Reader(const Reader &) = delete;
+
+            Reader &operator=(const Reader &) = delete;
+
+            void Enter() {
+                slot_->epoch.store(domain_->epoch_.load(std::memory_order_relaxed), std::memory_order_relaxed);
+                //槽位的写入必须先于之后读共享指针被写者看到
+                std::atomic_thread_fence(std::memory_order_seq_cst);
+            }
+
+            void Exit() {
+                slot_->epoch.store(0, std::memory_order_release);
+            }
+
+        private:
+            EpochDomain *domain_;
+            Slot *slot_;
+        };
+
+        class Guard {
+        public:
+            explicit Guard(Reader *reader) : reader_(reader) { reader_->Enter(); }
+
+            ~Guard() { reader_->Exit(); }
+
+            Guard(const Guard &) = delete;
+
+            Guard &operator=(const Guard &) = delete;
+
+        private:
+            Reader *reader_;
+        };
+
+        /**
+         * 在替换共享指针之后调用，返回时调用之前已经Enter的读者都已经Exit，旧对象可以释放。不能在Enter和Exit之间调用
+         */
+        void Synchronize();
+
+    private:
+        std::atomic<uint64_t> epoch_;
+        std::atomic<int> slot_num_; //登记过的最大槽位下标加一，Synchronize只扫描这些
+        Slot slots_[MAX_READERS];
+
+        Slot *AcquireSlot();
+    };
+}
+
+#endif //GOMOKU_EPOCHDOMAIN_H
@@ -8,7 +8,89 @@
 
 namespace gomoku {
 
-    int64_t Evalute::evaluate_1(const ChessBoardState &board) {
+    namespace {
+        //evaluate_3对一条线的打分：跳过左端的边界格，把线上的格子依次送进自动机，读到右端的边界格为止
+        template<int BOARD_SIZE>
+        int64_t EvaluateLine(uint64_t code) {
+            using Board = ChessBoardStateT<BOARD_SIZE>;
+            static const Chess kLineChess[4] = {EMPTY, BLACK, WHITE, EMPTY};
+            int64_t res = 0;
+            int64_t e1 = 0, e2 = 0, x = 0;
+            bool is_black;
+            auto sub_evaluate = [&]() -> int64_t {
+                //std::cout << e1 << " " << x << " " << e2 << std::endl;
+                if (e1 + e2 + x < 5) {
+                    return 0;
+                }
+                int64_t ans = (15 * x + e1) * (15 * x + e2);
+                if (!is_black) {
+                    ans = -ans;
+                }
+                return ans;
+            };
+            auto automaton_clear = [&]() -> void {
+                res += sub_evaluate();
+                e1 = 0;
+                e2 = 0;
+                x = 0;
+            };
+            auto automaton_move = [&](Chess chess) -> void {
+                e1 = e2;
+                e2 = 0;
+                x = 1;
+                is_black = (chess == Chess::BLACK);
+            };
+            auto automaton_push = [&](Chess chess) -> void {
+                if (chess == EMPTY) {
+                    if (x == 0) {
+                        e1++;
+                    } else {
+                        e2++;
+                    }
+                    return;
+                }
+                if (x == 0) {
+                    is_black = (chess == Chess::BLACK);
+                    x++;
+                    return;
+                }
+                if (e2 == 0 && is_black == (chess == Chess::BLACK)) {
+                    x++;
+                    return;
+                }
+                res += sub_evaluate();
+                automaton_move(chess);
+            };
+            while ((code & 3) == Board::LINE_BORDER) {
+                code >>= 2;
+            }
+            for (; (code & 3) != Board::LINE_BORDER; code >>= 2) {
+                automaton_push(kLineChess[code & 3]);
+            }
+            automaton_clear();
+            return res;
+        }
+
+        //线型编码到得分的直接映射缓存，每个线程一份。编码两端都有边界格，不会是0，0表示空槽
+        template<int BOARD_SIZE>
+        int64_t EvaluateLineCached(uint64_t code) {
+            static const int CACHE_BITS = 12;
+            struct Entry {
+                uint64_t code;
+                int64_t score;
+            };
+            thread_local Entry cache[1 << CACHE_BITS];
+            Entry &entry = cache[(code * 0x9E3779B97F4A7C15ULL) >> (64 - CACHE_BITS)];
+            if (entry.code != code) {
+                entry.code = code;
+                entry.score = EvaluateLine<BOARD_SIZE>(code);
+            }
+            return entry.score;
+        }
+    }
+
+    template<int BOARD_SIZE>
+    int64_t EvaluteT<BOARD_SIZE>::evaluate_1(const ChessBoardStateT<BOARD_SIZE> &board) {
         if (board.IsEnd() == 1) {
             return BLACK_WIN;
         }
@@ -16,8 +98,6 @@ namespace gomoku {
             return BLACK_LOSS;
         }
         int64_t result = 0;
-        std::map<std::pair<int, int>, Chess> pos2chess;
-        board.GetPositionMap(&pos2chess);
         std::vector<std::pair<int, int>> dir = {{1,  0},
                                                 {-1, 0},
                                                 {0,  1},
@@ -27,14 +107,15 @@ namespace gomoku {
                                                 {1,  -1},
                                                 {-1, 1}};
         //std::set<std::pair<int, int>> vis;
-        for (auto &it: pos2chess) {
+        for (int index = 0; index < board.GetMoveNums(); index++) {
             /*
              * 以当前棋子为中心计算得分
              * 对于一个棋子，在一个给定方向上，遇到对方棋子或者边界前一定呈现类似"111001"的排列,1代表棋子，0代表空格。
              * 对这样的序列进行计分即可
              * */
             int64_t score = 0;
-            int x = static_cast<int>(it.first.first), y = static_cast<int>(it.first.second);
+            int x, y;
+            const Chess chess = board.GetStone(index, &x, &y);
 //            if(vis.find(std::make_pair(x,y))!=vis.end()){
 //                continue;
 //            }
@@ -51,7 +132,7 @@ namespace gomoku {
                         next_j < 0 || next_j >= BOARD_SIZE) {
                         break;
                     }
-                    if (board.GetChessAt(next_i, next_j) == it.second) {
+                    if (board.GetChessAt(next_i, next_j) == chess) {
                         seq.emplace_back(1);
 //                        vis.emplace(std::make_pair(next_i,next_j));
                     } else if (board.GetChessAt(next_i, next_j) == EMPTY) {
@@ -88,7 +169,7 @@ namespace gomoku {
                 seq.insert(seq.end(), dir2seq[k + 1].begin(), dir2seq[k + 1].end());
                 score += EvaluateSeq(seq);
             }
-            if (it.second == WHITE) {
+            if (chess == WHITE) {
                 score = -score;
             }
             result += score;
@@ -96,7 +177,8 @@ namespace gomoku {
         return result;
     }
 
-    int64_t Evalute::evaluate_2(const ChessBoardState &board) {
+    template<int BOARD_SIZE>
+    int64_t EvaluteT<BOARD_SIZE>::evaluate_2(const ChessBoardStateT<BOARD_SIZE> &board) {
         if (board.IsEnd() == 1) {
             return BLACK_WIN;
         }
@@ -112,8 +194,6 @@ namespace gomoku {
             }
         }
 
-        std::map<std::pair<int, int>, Chess> pos2chess;
-        board.GetPositionMap(&pos2chess);
         std::vector<std::pair<int, int>> dir = {{1,  0},
                                                 {-1, 0},
                                                 {0,  1},
@@ -123,17 +203,18 @@ namespace gomoku {
                                                 {1,  -1},
                                                 {-1, 1}};
         //std::set<std::pair<int, int>> vis;
-        for (auto &it: pos2chess) {
+        for (int index = 0; index < board.GetMoveNums(); index++) {
             /*
              * 以当前棋子为中心计算得分
              * 对于一个棋子，在一个给定方向上，遇到对方棋子或者边界前一定呈现类似"111001"的排列,1代表棋子，0代表空格。
              * 对这样的序列进行计分即可
              * */
             int64_t score = 0;
-            int x = static_cast<int>(it.first.first), y = static_cast<int>(it.first.second);
-            if (it.second == BLACK) {
+            int x, y;
+            const Chess chess = board.GetStone(index, &x, &y);
+            if (chess == BLACK) {
                 score += 1 << (int64_t) position_value[x, y];
-            } else if (it.second == WHITE) {
+            } else if (chess == WHITE) {
                 score -= 1 << (int64_t) position_value[x, y];
             }
 
@@ -227,11 +308,11 @@ namespace gomoku {
                 else if (board.GetChessAt(x, y) == EMPTY) seq.emplace_back(0);
                 seq.insert(seq.end(), dir2seq[k + 1].begin(), dir2seq[k + 1].end());
                 std::pair<int64_t, int64_t> ans = EvaluateSeq(seq);
-                if (it.second == BLACK) {
+                if (chess == BLACK) {
                     score += ans.first;
                     score -= ans.second;
 
-                } else if (it.second == WHITE) {
+                } else if (chess == WHITE) {
                     score += ans.second;
                     score -= ans.first;
                     score = -score;
@@ -242,109 +323,30 @@ namespace gomoku {
         return result;
     }
 
-    int64_t Evalute::evaluate_3(const ChessBoardState &board) {
+    template<int BOARD_SIZE>
+    int64_t EvaluteT<BOARD_SIZE>::evaluate_3(const ChessBoardStateT<BOARD_SIZE> &board) {
         if (board.IsEnd() == 1) {
             return BLACK_WIN;
         }
         if (board.IsEnd() == -1) {
             return BLACK_LOSS;
         }
+        //横、竖、正对角、反对角：每条线的得分只取决于它的线型编码，搜索中相邻局面只有落子经过的4条线不同，
+        //其余线都能在缓存里直接命中
         int64_t res = 0;
-        int64_t e1 = 0, e2 = 0, x = 0;
-        bool is_black;
-        auto sub_evaluate = [&]() -> int64_t {
-            //std::cout << e1 << " " << x << " " << e2 << std::endl;
-            if (e1 + e2 + x < 5) {
-                return 0;
-            }
-            int64_t ans = (15 * x + e1) * (15 * x + e2);
-            if (!is_black) {
-                ans = -ans;
-            }
-            return ans;
-        };
-        auto automaton_clear = [&]() -> void {
-            res += sub_evaluate();
-            e1 = 0;
-            e2 = 0;
-            x = 0;
-        };
-        auto automaton_move = [&](Chess chess) -> void {
-            e1 = e2;
-            e2 = 0;
-            x = 1;
-            is_black = (chess == Chess::BLACK);
-        };
-        auto automaton_push = [&](Chess chess) -> void {
-            if (chess == EMPTY) {
-                if (x == 0) {
-                    e1++;
-                } else {
-                    e2++;
-                }
-                return;
-            }
-            if (x == 0) {
-                is_black = (chess == Chess::BLACK);
-                x++;
-                return;
-            }
-            if (e2 == 0 && is_black == (chess == Chess::BLACK)) {
-                x++;
-                return;
-            }
-            res += sub_evaluate();
-            automaton_move(chess);
-        };
-        //横
-        for (int i = 0; i < BOARD_SIZE; i++) {
-            for (int j = 0; j < BOARD_SIZE; j++) {
-                automaton_push(board.GetChessAt(i, j));
-            }
-            automaton_clear();
-        }
-        //竖
-        for (int j = 0; j < BOARD_SIZE; j++) {
-            for (int i = 0; i < BOARD_SIZE; i++) {
-                automaton_push(board.GetChessAt(i, j));
-            }
-            automaton_clear();
-        }
-        // 正对角
-        for (int s = 0; s < BOARD_SIZE; s++) {
-            int i = 0;
-            int j = s;
-            while (i < BOARD_SIZE && j < BOARD_SIZE) {
-                automaton_push(board.GetChessAt(i++, j++));
-            }
-            automaton_clear();
-        }
-        for (int s = 1; s < BOARD_SIZE; s++) {
-            int i = s;
-            int j = 0;
-            while (i < BOARD_SIZE && j < BOARD_SIZE) {
-                automaton_push(board.GetChessAt(i++, j++));
-            }
-            automaton_clear();
-        }
-        // 反对角
-        for (int s = 0; s < BOARD_SIZE; s++) {
-            int i = s;
-            int j = 0;
-            while (i >= 0 && i < BOARD_SIZE && j < BOARD_SIZE) {
-                automaton_push(board.GetChessAt(i--, j++));
-            }
-            automaton_clear();
-        }
-        for (int s = 1; s < BOARD_SIZE; s++) {
-            int i = BOARD_SIZE - 1;
-            int j = s;
-            while (i >= 0 && i < BOARD_SIZE && j < BOARD_SIZE) {
-                automaton_push(board.GetChessAt(i--, j++));
-            }
-            automaton_clear();
+        for (int line = 0; line < ChessBoardStateT<BOARD_SIZE>::LINE_NUM; line++) {
+            res += EvaluateLineCached<BOARD_SIZE>(board.GetLineCode(line));
         }
         return res;
     }
 
+    template
+    class EvaluteT<15>;
+
+    template
+    class EvaluteT<19>;
+
+    template
+    class EvaluteT<20>;
+
 }
\ No newline at end of file
@@ -8,13 +8,20 @@
 #define BLACK_WIN (1LL<<60)
 #define BLACK_LOSS -(BLACK_WIN)
 namespace gomoku {
-    class Evalute{
+    template<int BOARD_SIZE>
+    class EvaluteT{
     public:
-        static int64_t evaluate_1(const ChessBoardState &board);
-        static int64_t evaluate_2(const ChessBoardState &board);
-        static int64_t evaluate_3(const ChessBoardState &board);
+        static int64_t evaluate_1(const ChessBoardStateT<BOARD_SIZE> &board);
+        static int64_t evaluate_2(const ChessBoardStateT<BOARD_SIZE> &board);
+        static int64_t evaluate_3(const ChessBoardStateT<BOARD_SIZE> &board);
     };
 
+    extern template class EvaluteT<15>;
+    extern template class EvaluteT<19>;
+    extern template class EvaluteT<20>;
+
+    using Evalute = EvaluteT<BOARD_SIZE>;
+
 }
 
 
@@ -0,0 +1,148 @@
+//
+// Created by zrr on 2024/3/10.
+//
+
+#include "LinePattern.h"
+#include <vector>
+#include <cassert>
+
+namespace gomoku {
+
+    namespace {
+        enum Cell {
+            NONE = 0, OWN = 1, BLOCKED = 2
+        };
+        const int WIDTH = 2 * LinePattern::WINDOW_RADIUS + 1;
+        const int CENTER = LinePattern::WINDOW_RADIUS;
+
+        //经过中心的己方连子长度，连到窗口边上的按窗口内的长度算，对判断成五和长连已经足够
+        int RunLength(const int *cells) {
+            int left = CENTER, right = CENTER;
+            while (left > 0 && cells[left - 1] == OWN) {
+                left--;
+            }
+            while (right < WIDTH - 1 && cells[right + 1] == OWN) {
+                right++;
+            }
+            return right - left + 1;
+        }
+
+        bool IsFive(int run_length, bool exact_five) {
+            return exact_five ? run_length == 5 : run_length >= 5;
+        }
+
+        //再下一子就能成五的点，写出它们在窗口中的下标（从左到右），返回个数，至多两个
+        int FourPoints(int *cells, bool exact_five, int *points) {
+            int num = 0;
+            for (int i = 1; i < WIDTH - 1; i++) {
+                if (cells[i] != NONE) {
+                    continue;
+                }
+                cells[i] = OWN;
+                if (IsFive(RunLength(cells), exact_five)) {
+                    points[num++] = i;
+                }
+                cells[i] = NONE;
+            }
+            return num;
+        }
+
+        //两个成五点夹着四个己方棋子时是活四，只算一个四
+        int FourCount(int num, const int *points) {
+            if (num == 2 && points[1] - points[0] == 5) {
+                return 1;
+            }
+            return num;
+        }
+
+        uint16_t Classify(uint32_t own, uint32_t blocked, bool exact_five) {
+            int cells[WIDTH];
+            cells[CENTER] = OWN;
+            for (int k = 0; k < LinePattern::WINDOW_BITS; k++) {
+                const int i = k < CENTER ? k : k + 1;
+                if ((blocked >> k) & 1) {
+                    cells[i] = BLOCKED;
+                } else if ((own >> k) & 1) {
+                    cells[i] = OWN;
+                } else {
+                    cells[i] = NONE;
+                }
+            }
+            const int run_length = RunLength(cells);
+            if (IsFive(run_length, exact_five)) {
+                return LinePattern::FIVE;
+            }
+            if (run_length > 5) {
+                return LinePattern::OVERLINE;
+            }
+            int points[WIDTH];
+            const int fours = FourCount(FourPoints(cells, exact_five, points), points);
+            if (fours > 0) {
+                return static_cast<uint16_t>(fours << LinePattern::FOUR_SHIFT);
+            }
+            //活三：再下一子能形成活四，记下所有这样的点，供禁手判断确认这些点本身不是禁手
+            uint16_t three_points = 0;
+            for (int k = 0; k < 8; k++) {
+                const int i = CENTER + LinePattern::ThreePointOffset(k);
+                if (cells[i] != NONE) {
+                    continue;
+                }
+                cells[i] = OWN;
+                const int num = FourPoints(cells, exact_five, points);
+                if (num == 2 && FourCount(num, points) == 1) {
+                    three_points |= 1 << k;
+                }
+                cells[i] = NONE;
+            }
+            if (three_points == 0) {
+                return 0;
+            }
+            return static_cast<uint16_t>(LinePattern::OPEN_THREE | three_points << LinePattern::THREE_POINT_SHIFT);
+        }
+
+        //把10位二进制数的每一位当作一位三进制数，own + 2 * blocked就是窗口的三进制下标
+        struct TernaryTable {
+            uint16_t value[1 << LinePattern::WINDOW_BITS];
+        };
+
+        constexpr TernaryTable MakeTernaryTable() {
+            TernaryTable table{};
+            for (int bits = 0; bits < (1 << LinePattern::WINDOW_BITS); bits++) {
+                int value = 0;
+                for (int k = LinePattern::WINDOW_BITS - 1; k >= 0; k--) {
+                    value = value * 3 + ((bits >> k) & 1);
+                }
+                table.value[bits] = static_cast<uint16_t>(value);
+            }
+            return table;
+        }
+
+        constexpr TernaryTable kTernary = MakeTernaryTable();
+
+        const int TABLE_SIZE = 59049; // 3^WINDOW_BITS
+
+        std::vector<uint16_t> BuildTable(bool exact_five) {
+            std::vector<uint16_t> table(TABLE_SIZE);
+            for (uint32_t own = 0; own < (1u << LinePattern::WINDOW_BITS); own++) {
+                //同一格不会既是己方棋子又被挡住
+                for (uint32_t blocked = 0; blocked < (1u << LinePattern::WINDOW_BITS); blocked++) {
+                    if ((own & blocked) == 0) {
+                        table[kTernary.value[own] + 2 * kTernary.value[blocked]] = Classify(own, blocked, exact_five);
+                    }
+                }
+            }
+            return table;
+        }
+    }
+
+    uint16_t LinePattern::Lookup(uint32_t own, uint32_t blocked, bool exact_five) {
+        assert((own & blocked) == 0);
+        //两张表各118KB，分别在第一次用到时生成
+        if (exact_five) {
+            static const std::vector<uint16_t> exact_table = BuildTable(true);
+            return exact_table[kTernary.value[own] + 2 * kTernary.value[blocked]];
+        }
+        static const std::vector<uint16_t> table = BuildTable(false);
+        return table[kTernary.value[own] + 2 * kTernary.value[blocked]];
+    }
+}
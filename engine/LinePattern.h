@@ -0,0 +1,43 @@
+//
+// Created by zrr on 2024/3/10.
+//
+#include <stdint.h>
+
+#ifndef GOMOKU_LINEPATTERN_H
+#define GOMOKU_LINEPATTERN_H
+namespace gomoku {
+    /**
+     * 线型表：在一条线的某个空点落下己方棋子后，这条线上经过该点形成的棋型。
+     * 窗口取该点左右各WINDOW_RADIUS格，左边从远到近、右边从近到远依次编号0~9，
+     * own是其中的己方棋子，blocked是挡住己方的格子（对方棋子或棋盘外），两者按格子编号各占10位。
+     * 表按三进制下标存放，只有3^10项，能留在缓存里。
+     * exact_five为true时只有恰好五连算成五，长连单独标出（禁手规则下的黑棋），否则五连及以上都算成五
+     */
+    class LinePattern {
+    public:
+        static const int WINDOW_RADIUS = 5;
+        static const int WINDOW_BITS = 2 * WINDOW_RADIUS;
+
+        enum : uint16_t {
+            FIVE = 1 << 0,
+            OVERLINE = 1 << 1,
+            FOUR_SHIFT = 2, //冲四的个数（0~2），一条线上也可能同时有两个冲四，活四算一个
+            FOUR_MASK = 3 << FOUR_SHIFT,
+            OPEN_THREE = 1 << 4,
+            THREE_POINT_SHIFT = 5, //能把活三变成活四的点，第k位对应ThreePointOffset(k)
+        };
+
+        static uint16_t Lookup(uint32_t own, uint32_t blocked, bool exact_five);
+
+        static int FourCount(uint16_t pattern) { return (pattern & FOUR_MASK) >> FOUR_SHIFT; }
+
+        static uint32_t ThreePoints(uint16_t pattern) { return pattern >> THREE_POINT_SHIFT; }
+
+        /**
+         * 活三点掩码第k位对应的格子相对落子点的偏移，k∈[0,8)，对应-4~-1和1~4
+         */
+        static int ThreePointOffset(int k) { return k < 4 ? k - 4 : k - 3; }
+    };
+}
+
+#endif //GOMOKU_LINEPATTERN_H
@@ -9,294 +9,980 @@
 #include "glog/logging.h"
 #include "common/timeutility.h"
 #include "common/defer.h"
-#include "common/rw_lock.h"
 #include <cmath>
 #include <chrono>
 #include <thread>
 #include <cassert>
-#include <random>
+#include "Random.h"
 #include <fstream>
 #include <algorithm>
 
 namespace gomoku {
-    MCTSEngine::MCTSEngine(int thread_num, double explore_c) : C(explore_c), thread_num_(thread_num) {
+    bool ParseParallelMode(const std::string &name, ParallelMode *mode) {
+        if (name == "tree") {
+            *mode = TREE_PARALLEL;
+        } else if (name == "root") {
+            *mode = ROOT_PARALLEL;
+        } else {
+            return false;
+        }
+        return true;
+    }
 
+    bool ParseRolloutPolicy(const std::string &name, RolloutPolicy *policy) {
+        if (name == "random") {
+            *policy = ROLLOUT_RANDOM;
+        } else if (name == "local") {
+            *policy = ROLLOUT_LOCAL;
+        } else if (name == "decisive") {
+            *policy = ROLLOUT_DECISIVE;
+        } else {
+            return false;
+        }
+        return true;
     }
 
-    bool MCTSEngine::StartSearch(const ChessBoardState &state, bool black_first) {
+    void PlayoutStats::Add(BoardResult res) {
+        n++;
+        if (res == BoardResult::BLACK_WIN) {
+            black_win++;
+        } else if (res == BoardResult::WHITE_WIN) {
+            white_win++;
+        }
+    }
+
+    template<int BOARD_SIZE>
+    const int MCTSEngineT<BOARD_SIZE>::ROOT_SYNC_INTERVAL_MS;
+
+    template<int BOARD_SIZE>
+    MCTSEngineT<BOARD_SIZE>::MCTSEngineT(int thread_num, double explore_c) : C(explore_c), pool_(nullptr),
+                                                                             search_job_(0), pin_threads_(false),
+                                                                             thread_num_(thread_num),
+                                                                             root_(nullptr),
+                                                                             rule_set_(FREESTYLE),
+                                                                             huge_pages_(false), virtual_loss_(1),
+                                                                             transposition_(false),
+                                                                             parallel_mode_(TREE_PARALLEL),
+                                                                             share_plies_(1), leaf_playouts_(1),
+                                                                             rollout_policy_(ROLLOUT_RANDOM), seed_(0),
+                                                                             worker_seq_(0),
+                                                                             root_epoch_(0),
+                                                                             first_playout_threads_(0),
+                                                                             first_playout_us_(-1), action_us_(-1),
+                                                                             merged_epoch_(0), sync_request_(0),
+                                                                             sync_acks_(0) {
+
+    }
+
+    template<int BOARD_SIZE>
+    MCTSEngineT<BOARD_SIZE>::~MCTSEngineT() {
+        stop_.store(true);
+        if (pool_ != nullptr) {
+            pool_->Wait(search_job_);
+        }
+        reclaim_pool_.Stop();
+        ReclaimRetired();
+        delete root_.load();
+    }
+
+    template<int BOARD_SIZE>
+    bool MCTSEngineT<BOARD_SIZE>::StartSearch(const ChessBoardStateT<BOARD_SIZE> &state, bool black_first) {
         std::cout << "thread_num_: " << thread_num_ << std::endl;
         assert(thread_num_ < 512);
+        //上一次搜索还在进行时先让它的线程退出，否则Run会一直等它结束
+        Stop();
         stop_.store(false);
         LOG(INFO) << __func__ << " board: " << state.hash() << " black_first: " << black_first;
         //初始化根节点x
-        root_node_ = std::make_shared<Node>(black_first, this);
-        root_board_ = std::make_shared<ChessBoardState>(state);
-        threadPool.Init(thread_num_, std::bind(&MCTSEngine::LoopExpandTree, this));
-        threadPool.Start();
+        auto root = new RootState();
+        root->arena = std::make_shared<NodeArena>(huge_pages_);
+        root->table = transposition_ ? std::make_shared<NodeTable<Node<BOARD_SIZE>>>() : nullptr;
+        root->node = Node<BOARD_SIZE>::NewRoot(root->arena.get(), black_first, this);
+        root->board = state;
+        root->board.SetRuleSet(rule_set_);
+        //搜索用的局面都从根的局面复制，打开一次之后树上和模拟中的每步落子都增量维护成五点
+        root->board.SetThreatTracking(rollout_policy_ == ROLLOUT_DECISIVE, ChessBoardStateT<BOARD_SIZE>::THREAT_FIVE);
+        root->epoch = ++root_epoch_;
+        root->start_us = common::TimeUtility::GetTimeofDayUs();
+        {
+            std::lock_guard<std::mutex> guard(root_update_lock_);
+            PublishRoot(root);
+        }
+        ReclaimRetired();
+        first_playout_threads_ = 0;
+        first_playout_us_ = -1;
+        {
+            std::lock_guard<std::mutex> guard(merged_lock_);
+            merged_stats_.clear();
+            merged_epoch_ = root_epoch_;
+        }
+        worker_seq_ = 0;
+        if (pool_ == nullptr) {
+            threadPool.InitPersistent(thread_num_, pin_threads_);
+            threadPool.Start();
+            pool_ = &threadPool;
+        }
+        reclaim_pool_.Start(1);
+        if (parallel_mode_ == ROOT_PARALLEL) {
+            search_job_ = pool_->Run(thread_num_, std::bind(&MCTSEngineT::LoopRootParallel, this));
+        } else {
+            search_job_ = pool_->Run(thread_num_, std::bind(&MCTSEngineT::LoopExpandTree, this));
+        }
+        if (search_job_ == 0) {
+            LOG(ERROR) << "thread pool can not run " << thread_num_ << " search threads";
+            return false;
+        }
         return true;
     }
 
-    void MCTSEngine::LoopExpandTree() {
+    template<int BOARD_SIZE>
+    void MCTSEngineT<BOARD_SIZE>::SetRuleSet(RuleSet rule_set) {
+        rule_set_ = rule_set;
+    }
+
+    template<int BOARD_SIZE>
+    void MCTSEngineT<BOARD_SIZE>::SetHugePages(bool huge_pages) {
+        huge_pages_ = huge_pages;
+    }
+
+    template<int BOARD_SIZE>
+    void MCTSEngineT<BOARD_SIZE>::SetVirtualLoss(int virtual_loss) {
+        virtual_loss_ = virtual_loss;
+    }
+
+    template<int BOARD_SIZE>
+    void MCTSEngineT<BOARD_SIZE>::SetTransposition(bool transposition) {
+        transposition_ = transposition;
+    }
+
+    template<int BOARD_SIZE>
+    void MCTSEngineT<BOARD_SIZE>::SetParallelMode(ParallelMode mode) {
+        parallel_mode_ = mode;
+    }
+
+    template<int BOARD_SIZE>
+    void MCTSEngineT<BOARD_SIZE>::SetSharePlies(int share_plies) {
+        share_plies_ = share_plies;
+    }
+
+    template<int BOARD_SIZE>
+    void MCTSEngineT<BOARD_SIZE>::SetLeafPlayouts(int leaf_playouts) {
+        leaf_playouts_ = leaf_playouts;
+    }
+
+    template<int BOARD_SIZE>
+    void MCTSEngineT<BOARD_SIZE>::SetRolloutPolicy(RolloutPolicy policy) {
+        rollout_policy_ = policy;
+    }
+
+    template<int BOARD_SIZE>
+    void MCTSEngineT<BOARD_SIZE>::SetSeed(uint64_t seed) {
+        seed_ = seed;
+    }
+
+    template<int BOARD_SIZE>
+    void MCTSEngineT<BOARD_SIZE>::SetThreadPool(common::ThreadPool *pool) {
+        pool_ = pool;
+    }
+
+    template<int BOARD_SIZE>
+    void MCTSEngineT<BOARD_SIZE>::SetPinThreads(bool pin_threads) {
+        pin_threads_ = pin_threads;
+    }
+
+    template<int BOARD_SIZE>
+    void MCTSEngineT<BOARD_SIZE>::SeedWorker() {
+        if (seed_ != 0) {
+            SeedThreadRandom(seed_ + worker_seq_.fetch_add(1));
+        }
+    }
+
+    template<int BOARD_SIZE>
+    void MCTSEngineT<BOARD_SIZE>::LoopExpandTree() {
         LOG(WARNING) << "start loop expand tree";
+        SeedWorker();
+        int64_t done_epoch = 0;
+        EpochDomain::Reader reader(&epoch_domain_);
+        while (!stop_.load()) {
+            //每轮只在自己的槽位上记一下纪元，不加锁也不增减共享的引用计数
+            SearchCtx<BOARD_SIZE> ctx;
+            uint64_t root_start_us;
+            {
+                EpochDomain::Guard guard(&reader);
+                auto root = root_.load(std::memory_order_acquire);
+                ctx.board = root->board;
+                ctx.root = root->node;
+                ctx.root_epoch = root->epoch;
+                ctx.arena = root->arena.get();
+                ctx.table = root->table.get();
+                root_start_us = root->start_us;
+                ctx.root->ExpandTree(&ctx);
+            }
+            FinishPlayout(ctx.root_epoch, root_start_us, &done_epoch);
+        }
+    }
+
+    template<int BOARD_SIZE>
+    void MCTSEngineT<BOARD_SIZE>::FinishPlayout(int64_t epoch, uint64_t root_start_us, int64_t *done_epoch) {
+        if (epoch == *done_epoch) {
+            return;
+        }
+        *done_epoch = epoch;
+        if (epoch == root_epoch_.load() && first_playout_threads_.fetch_add(1) + 1 == thread_num_) {
+            int64_t cost = common::TimeUtility::GetTimeofDayUs() - root_start_us;
+            first_playout_us_.store(cost);
+            LOG(INFO) << "all " << thread_num_ << " threads finish first playout in " << cost << " us";
+        }
+    }
+
+    template<int BOARD_SIZE>
+    void MCTSEngineT<BOARD_SIZE>::LoopRootParallel() {
+        LOG(WARNING) << "start loop root parallel";
+        SeedWorker();
+        int64_t done_epoch = 0;
+        int64_t request = sync_request_.load();
+        EpochDomain::Reader reader(&epoch_domain_);
         while (!stop_.load()) {
-            std::shared_ptr<Node> root_node;
-            SearchCtx ctx;
+            //每个根各建一棵私有树，节点只有本线程访问，换根后整棵丢掉
+            ChessBoardStateT<BOARD_SIZE> board;
+            SearchCtx<BOARD_SIZE> ctx;
+            bool is_black;
+            uint64_t root_start_us;
             {
-                common::ReadLockGuard gurad(root_lock_);
-                ctx.board = *root_board_;
-                root_node = root_node_;
+                EpochDomain::Guard guard(&reader);
+                auto root = root_.load(std::memory_order_acquire);
+                board = root->board;
+                is_black = root->node->is_black;
+                ctx.root_epoch = root->epoch;
+                root_start_us = root->start_us;
+            }
+            NodeArena arena(huge_pages_);
+            SyncStates states;
+            ctx.arena = &arena;
+            ctx.table = nullptr;
+            ctx.root = arena.New<Node<BOARD_SIZE>>(is_black, this);
+            int64_t playout_num = 0;
+            auto last_sync_ms = common::TimeUtility::GetTimeofDayMs();
+            while (!stop_.load(std::memory_order_relaxed) &&
+                   root_epoch_.load(std::memory_order_relaxed) == ctx.root_epoch) {
+                ctx.board = board;
+                ctx.root->ExpandTree(&ctx);
+                FinishPlayout(ctx.root_epoch, root_start_us, &done_epoch);
+                bool requested = sync_request_.load(std::memory_order_relaxed) != request;
+                if (requested || (++playout_num % 64 == 0 &&
+                                  common::TimeUtility::GetTimeofDayMs() - last_sync_ms >= ROOT_SYNC_INTERVAL_MS)) {
+                    SyncRootWorker(ctx.root_epoch, ctx.root, &board, &states, &request);
+                    last_sync_ms = common::TimeUtility::GetTimeofDayMs();
+                }
             }
-            root_node->ExpandTree(&ctx);
+            SyncRootWorker(ctx.root_epoch, ctx.root, &board, &states, &request);
         }
     }
 
-    bool MCTSEngine::Stop() {
+    template<int BOARD_SIZE>
+    void MCTSEngineT<BOARD_SIZE>::SyncRootWorker(int64_t epoch, Node<BOARD_SIZE> *root,
+                                                 ChessBoardStateT<BOARD_SIZE> *board, SyncStates *states,
+                                                 int64_t *request) {
+        std::lock_guard<std::mutex> guard(merged_lock_);
+        if (epoch == merged_epoch_) {
+            SyncNode(root, nullptr, 0, board, 0, states);
+        }
+        if (*request != sync_request_.load()) {
+            *request = sync_request_.load();
+            sync_acks_++;
+            merged_cv_.notify_all();
+        }
+    }
+
+    template<int BOARD_SIZE>
+    void MCTSEngineT<BOARD_SIZE>::SyncNode(Node<BOARD_SIZE> *node, Node<BOARD_SIZE> *parent, int slot,
+                                           ChessBoardStateT<BOARD_SIZE> *board, int depth, SyncStates *states) {
+        //不同着法顺序到达的同一局面只同步最先登记的那个节点
+        auto &state = (*states)[board->hash128()];
+        if (state.node == nullptr) {
+            state.node = node;
+        } else if (state.node != node) {
+            return;
+        }
+        //节点上的统计减去加进来的其他线程的统计就是本线程自己的
+        PlayoutStats own = node->GetStats();
+        own.n -= state.injected.n;
+        own.black_win -= state.injected.black_win;
+        own.white_win -= state.injected.white_win;
+        auto &merged = merged_stats_[board->hash128()];
+        merged.n += own.n - state.published.n;
+        merged.black_win += own.black_win - state.published.black_win;
+        merged.white_win += own.white_win - state.published.white_win;
+        state.published = own;
+        if (share_plies_ > 0 && depth <= share_plies_) {
+            PlayoutStats add;
+            add.n = merged.n - own.n - state.injected.n;
+            add.black_win = merged.black_win - own.black_win - state.injected.black_win;
+            add.white_win = merged.white_win - own.white_win - state.injected.white_win;
+            node->UpdateValue(add);
+            if (parent != nullptr) {
+                parent->child_n_[slot].fetch_add(add.n, std::memory_order_relaxed);
+                parent->child_win_[slot].fetch_add(parent->is_black ? add.black_win : add.white_win,
+                                                   std::memory_order_relaxed);
+            }
+            state.injected.n += add.n;
+            state.injected.black_win += add.black_win;
+            state.injected.white_win += add.white_win;
+        }
+        if (depth >= std::max(share_plies_, 1) || !node->inited.load(std::memory_order_acquire)) {
+            return;
+        }
+        for (int i = 0; i < node->child_num_; i++) {
+            auto child_node = node->children_[i].node.load(std::memory_order_acquire);
+            if (child_node != nullptr) {
+                board->Push(node->children_[i].move);
+                SyncNode(child_node, node, i, board, depth + 1, states);
+                board->Pop();
+            }
+        }
+    }
+
+    template<int BOARD_SIZE>
+    void MCTSEngineT<BOARD_SIZE>::RequestSync(std::unique_lock<std::mutex> *lock) {
+        sync_request_++;
+        sync_acks_ = 0;
+        merged_cv_.wait_for(*lock, std::chrono::milliseconds(ROOT_SYNC_INTERVAL_MS), [this]() {
+            return sync_acks_ >= thread_num_ || stop_.load();
+        });
+    }
+
+    template<int BOARD_SIZE>
+    bool MCTSEngineT<BOARD_SIZE>::GetMergedBest(ChessBoardStateT<BOARD_SIZE> *board, bool is_black, ChessMove *move,
+                                                double *rate) {
+        ChessMove moves[BOARD_SIZE * BOARD_SIZE];
+        int move_num = Node<BOARD_SIZE>::GenerateMoves(*board, is_black, moves);
+        bool found = false;
+        for (int i = 0; i < move_num; i++) {
+            board->Push(moves[i]);
+            auto it = merged_stats_.find(board->hash128());
+            board->Pop();
+            if (it == merged_stats_.end() || it->second.n == 0) {
+                continue;
+            }
+            double r = static_cast<double>(is_black ? it->second.black_win : it->second.white_win) /
+                       static_cast<double>(it->second.n);
+            if (!found || r > *rate) {
+                *move = moves[i];
+                *rate = r;
+                found = true;
+            }
+        }
+        return found;
+    }
+
+    template<int BOARD_SIZE>
+    bool MCTSEngineT<BOARD_SIZE>::Stop() {
         stop_.store(true);
         auto start = common::TimeUtility::GetTimeofDayMs();
-        threadPool.Stop();
+        if (pool_ != nullptr) {
+            pool_->Wait(search_job_);
+        }
+        ReclaimRetired();
         LOG(INFO) << "thread pool stop in "
                   << common::TimeUtility::GetTimeofDayMs() - start << " ms";
         return true;
     }
 
-    bool MCTSEngine::Action(ChessMove move) {
-        std::shared_ptr<Node> node;
+    template<int BOARD_SIZE>
+    bool MCTSEngineT<BOARD_SIZE>::Action(ChessMove move) {
+        //只在原来的NodeArena里换根，不拷贝也不释放节点，整理交给后台线程
+        auto start = common::TimeUtility::GetTimeofDayUs();
+        int64_t epoch;
+        bool end;
         {
-            common::ReadLockGuard gurad1(root_node_->move2node_lock_);
-            for (auto &move_node: root_node_->move2node_) {
-                if (move == move_node.first) {
-                    node = move_node.second;
-                    break;
+            std::lock_guard<std::mutex> guard(root_update_lock_);
+            //写者互斥，旧的根在替换之前不会被回收，不需要进临界区
+            auto old = root_.load(std::memory_order_acquire);
+            Node<BOARD_SIZE> *node = nullptr;
+            if (old->node->inited.load(std::memory_order_acquire)) {
+                for (int i = 0; i < old->node->child_num_; i++) {
+                    auto &child = old->node->children_[i];
+                    auto child_node = child.node.load(std::memory_order_acquire);
+                    if (child.move == move && child_node != nullptr) {
+                        node = child_node;
+                        break;
+                    }
                 }
             }
+            if (node == nullptr) {
+                node = Node<BOARD_SIZE>::NewRoot(old->arena.get(), !old->node->is_black, this);
+            }
+            auto root = new RootState(*old);
+            bool ok = root->board.Move(move);
+            assert(ok);
+            root->node = node;
+            root->epoch = epoch = root_epoch_.load() + 1;
+            root->start_us = common::TimeUtility::GetTimeofDayUs();
+            end = root->board.End() != BoardResult::NOT_END;
+            //先换编号再发布，拿到新根的线程看到的一定是新的编号
+            root_epoch_.store(epoch);
+            first_playout_threads_ = 0;
+            first_playout_us_ = -1;
+            PublishRoot(root);
         }
-        if (node == nullptr) {
-            node = std::make_shared<Node>(!root_node_->is_black, this);
-        }
-        {
-            common::WriteLockGuard guard(root_lock_);
-            assert(root_board_->Move(move));
-            root_node_ = node;
+        if (parallel_mode_ == ROOT_PARALLEL) {
+            //各线程看到root_epoch_变化后自己丢掉私有树
+            {
+                std::lock_guard<std::mutex> guard(merged_lock_);
+                merged_stats_.clear();
+                merged_epoch_ = epoch;
+            }
+            reclaim_pool_.Enqueue(&MCTSEngineT::ReclaimRetired, this);
+        } else {
+            reclaim_pool_.Enqueue(&MCTSEngineT::CompactTree, this, epoch);
         }
-        if (root_board_->End() != BoardResult::NOT_END) {
+        if (end) {
             Stop();
         }
+        int64_t cost = common::TimeUtility::GetTimeofDayUs() - start;
+        action_us_.store(cost);
+        LOG(INFO) << "action " << move << " in " << cost << " us";
         return true;
     }
 
-    ChessMove MCTSEngine::GetResult() {
-        bool is_black;
+    template<int BOARD_SIZE>
+    void MCTSEngineT<BOARD_SIZE>::CompactTree(int64_t epoch) {
+        //保留的子树拷到新的NodeArena里，其余节点随旧的NodeArena整体释放，不再逐个析构。
+        //拷贝期间搜索照常进行，拷完再把这期间旧树上新增的统计补上；期间又换了根则放弃这次拷贝
+        auto start = common::TimeUtility::GetTimeofDayMs();
+        int64_t node_num = 0;
+        size_t release_blocks = 0;
+        bool compacted = false;
+        //临界区里只复制一份RootState，它持有的arena、table让旧树在拷贝期间不被释放。
+        //拷贝不在临界区里，Stop、StartSearch回收旧根时不用等它拷完
+        RootState old;
         {
-            common::ReadLockGuard guard(root_lock_);
-            is_black = root_node_->is_black;
+            EpochDomain::Reader reader(&epoch_domain_);
+            EpochDomain::Guard read_guard(&reader);
+            old = *root_.load(std::memory_order_acquire);
+        }
+        if (old.epoch == epoch) {
+            auto root = new RootState(old);
+            root->arena = std::make_shared<NodeArena>(huge_pages_);
+            root->table = old.table ? std::make_shared<NodeTable<Node<BOARD_SIZE>>>() : nullptr;
+            root->node = old.node->CopyTo(root->arena.get(), root->table.get(), &root->board, &node_num, true);
+            std::unordered_set<const Node<BOARD_SIZE> *> visited;
+            root->node->RefreshStats(old.node, root->table ? &visited : nullptr);
+            std::lock_guard<std::mutex> guard(root_update_lock_);
+            if (root_epoch_ == epoch) {
+                release_blocks = old.arena->GetBlockNum();
+                PublishRoot(root);
+                compacted = true;
+            } else {
+                delete root;
+            }
+        }
+        ReclaimRetired();
+        if (compacted) {
+            LOG(INFO) << "compact tree keep nodes: " << node_num << " in "
+                      << common::TimeUtility::GetTimeofDayMs() - start << " ms, release blocks: " << release_blocks;
+        }
+    }
+
+    template<int BOARD_SIZE>
+    void MCTSEngineT<BOARD_SIZE>::PublishRoot(RootState *state) {
+        auto old = root_.exchange(state);
+        if (old != nullptr) {
+            std::lock_guard<std::mutex> guard(retired_lock_);
+            retired_.push_back(old);
         }
-        auto move = std::max_element(root_node_->move2node_.begin(), root_node_->move2node_.end(),
-                                     [is_black](const std::pair<ChessMove, std::shared_ptr<Node>> &x,
-                                                const std::pair<ChessMove, std::shared_ptr<Node>> &y) -> bool {
-                                         return x.second->GetWinRate(is_black) < y.second->GetWinRate(is_black);
-                                     })->first;
-        return move;
     }
 
-    void MCTSEngine::DumpTree() {
+    template<int BOARD_SIZE>
+    void MCTSEngineT<BOARD_SIZE>::ReclaimRetired() {
+        std::vector<RootState *> retired;
+        {
+            std::lock_guard<std::mutex> guard(retired_lock_);
+            retired.swap(retired_);
+        }
+        if (retired.empty()) {
+            return;
+        }
+        epoch_domain_.Synchronize();
+        for (auto state: retired) {
+            delete state;
+        }
+    }
+
+    template<int BOARD_SIZE>
+    int64_t MCTSEngineT<BOARD_SIZE>::GetActionUs() {
+        return action_us_.load();
+    }
+
+    template<int BOARD_SIZE>
+    size_t MCTSEngineT<BOARD_SIZE>::GetMemoryBytes() {
+        EpochDomain::Reader reader(&epoch_domain_);
+        EpochDomain::Guard guard(&reader);
+        auto root = root_.load(std::memory_order_acquire);
+        return root->arena->GetBlockNum() * NodeArena::BLOCK_SIZE + (root->table ? root->table->GetMemoryBytes() : 0);
+    }
+
+    template<int BOARD_SIZE>
+    int64_t MCTSEngineT<BOARD_SIZE>::GetTranspositionHits() {
+        EpochDomain::Reader reader(&epoch_domain_);
+        EpochDomain::Guard guard(&reader);
+        auto root = root_.load(std::memory_order_acquire);
+        return root->table ? root->table->GetHitNum() : 0;
+    }
+
+    template<int BOARD_SIZE>
+    ChessMove MCTSEngineT<BOARD_SIZE>::GetResult(double *win_rate) {
+        if (parallel_mode_ == ROOT_PARALLEL) {
+            ChessBoardStateT<BOARD_SIZE> board;
+            bool is_black;
+            {
+                EpochDomain::Reader reader(&epoch_domain_);
+                EpochDomain::Guard guard(&reader);
+                auto root = root_.load(std::memory_order_acquire);
+                board = root->board;
+                is_black = root->node->is_black;
+            }
+            std::unique_lock<std::mutex> lock(merged_lock_);
+            RequestSync(&lock);
+            ChessMove move;
+            double rate = 0;
+            GetMergedBest(&board, is_black, &move, &rate);
+            if (win_rate != nullptr) {
+                *win_rate = rate;
+            }
+            return move;
+        }
+        EpochDomain::Reader reader(&epoch_domain_);
+        EpochDomain::Guard guard(&reader);
+        auto root_node = root_.load(std::memory_order_acquire)->node;
+        auto child = root_node->GetBestChild(root_node->is_black);
+        if (win_rate != nullptr) {
+            *win_rate = child != nullptr ? child->node.load(std::memory_order_acquire)->GetWinRate(root_node->is_black)
+                                         : 0;
+        }
+        return child != nullptr ? child->move : ChessMove();
+    }
+
+    template<int BOARD_SIZE>
+    void MCTSEngineT<BOARD_SIZE>::DumpTree() {
+        if (parallel_mode_ == ROOT_PARALLEL) {
+            LOG(WARNING) << "root parallel mode has no shared tree to dump";
+            return;
+        }
+        EpochDomain::Reader reader(&epoch_domain_);
+        EpochDomain::Guard guard(&reader);
+        auto root_node = root_.load(std::memory_order_acquire)->node;
         std::ofstream outputFile("tree.txt");
-        outputFile << "root_n:" << root_node_->n << std::endl;
-        PrintNode(outputFile, root_node_.get(), ChessMove(), 0);
+        outputFile << "root_n:" << root_node->N() << std::endl;
+        PrintNode(outputFile, root_node, ChessMove(), 0, root_node->N());
         outputFile.close();
     }
 
-    void MCTSEngine::PrintNode(std::ostream &os, Node *node, ChessMove move, int deep) {
+    template<int BOARD_SIZE>
+    void MCTSEngineT<BOARD_SIZE>::PrintNode(std::ostream &os, Node<BOARD_SIZE> *node, ChessMove move, int deep,
+                                            int64_t total_n) {
         os << "\n";
         for (int i = 0; i < deep; i++) {
             os << "\t";
         }
         os << move;
-        os << " value:" << node->GetValue() << " b_win rate:"
-           << node->GetWinRate(true) << " w_win rate:" << node->GetWinRate(false) << " bwc:" << node->black_win_count
-           << " wwc" << node->white_win_count << " n:" << node->n;
-        for (auto &move_node: node->move2node_) {
-            PrintNode(os, move_node.second.get(), move_node.first, deep + 1);
+        os << " value:" << node->GetValue(total_n) << " b_win rate:"
+           << node->GetWinRate(true) << " w_win rate:" << node->GetWinRate(false) << " bwc:" << node->BlackWin()
+           << " wwc" << node->WhiteWin() << " n:" << node->N();
+        if (!node->inited.load(std::memory_order_acquire)) {
+            return;
+        }
+        for (int i = 0; i < node->child_num_; i++) {
+            auto child_node = node->children_[i].node.load(std::memory_order_acquire);
+            if (child_node != nullptr) {
+                PrintNode(os, child_node, node->children_[i].move, deep + 1, total_n);
+            }
         }
     }
 
-    int64_t MCTSEngine::GetRootN() {
-        return root_node_->n;
+    template<int BOARD_SIZE>
+    int64_t MCTSEngineT<BOARD_SIZE>::GetRootN() {
+        if (parallel_mode_ == ROOT_PARALLEL) {
+            ZobristKey128 key;
+            {
+                EpochDomain::Reader reader(&epoch_domain_);
+                EpochDomain::Guard guard(&reader);
+                key = root_.load(std::memory_order_acquire)->board.hash128();
+            }
+            std::lock_guard<std::mutex> guard(merged_lock_);
+            auto it = merged_stats_.find(key);
+            return it != merged_stats_.end() ? it->second.n : 0;
+        }
+        EpochDomain::Reader reader(&epoch_domain_);
+        EpochDomain::Guard guard(&reader);
+        return root_.load(std::memory_order_acquire)->node->N();
     }
 
-    void MCTSEngine::LogPath() {
-        std::shared_ptr<Node> root_node;
-        {
-            common::ReadLockGuard gurad(root_lock_);
-            root_node = root_node_;
+    template<int BOARD_SIZE>
+    void MCTSEngineT<BOARD_SIZE>::LogPath() {
+        if (parallel_mode_ == ROOT_PARALLEL) {
+            //只有合并过的前几层有统计
+            ChessBoardStateT<BOARD_SIZE> board;
+            bool is_black;
+            {
+                EpochDomain::Reader reader(&epoch_domain_);
+                EpochDomain::Guard guard(&reader);
+                auto root = root_.load(std::memory_order_acquire);
+                board = root->board;
+                is_black = root->node->is_black;
+            }
+            std::stringstream s;
+            std::lock_guard<std::mutex> guard(merged_lock_);
+            ChessMove move;
+            double rate;
+            for (int depth = 0; depth < std::max(share_plies_, 1) && board.End() == BoardResult::NOT_END &&
+                                GetMergedBest(&board, is_black, &move, &rate); depth++) {
+                s << move << " (" << rate << ") " << " ---> ";
+                board.Push(move);
+                is_black = !is_black;
+            }
+            LOG(INFO) << s.str();
+            return;
         }
+        EpochDomain::Reader reader(&epoch_domain_);
+        EpochDomain::Guard guard(&reader);
+        auto root_node = root_.load(std::memory_order_acquire)->node;
         std::stringstream s;
-        LogPathNode(s, root_node.get());
+        LogPathNode(s, root_node);
         LOG(INFO) << s.str();
     }
 
-    void MCTSEngine::LogPathNode(std::stringstream &line, Node *node) {
-        std::pair<ChessMove, std::shared_ptr<Node>> *move_node = nullptr;
-        bool is_black = node->is_black;
-        {
-            common::ReadLockGuard guard(node->move2node_lock_);
-            if (node->move2node_.empty()) {
-                return;
+    template<int BOARD_SIZE>
+    void MCTSEngineT<BOARD_SIZE>::GetRootVisits(std::vector<std::pair<ChessMove, int64_t>> *visits) {
+        if (parallel_mode_ == ROOT_PARALLEL) {
+            ChessBoardStateT<BOARD_SIZE> board;
+            bool is_black;
+            {
+                EpochDomain::Reader reader(&epoch_domain_);
+                EpochDomain::Guard guard(&reader);
+                auto root = root_.load(std::memory_order_acquire);
+                board = root->board;
+                is_black = root->node->is_black;
+            }
+            ChessMove moves[BOARD_SIZE * BOARD_SIZE];
+            int move_num = Node<BOARD_SIZE>::GenerateMoves(board, is_black, moves);
+            std::lock_guard<std::mutex> guard(merged_lock_);
+            for (int i = 0; i < move_num; i++) {
+                board.Push(moves[i]);
+                auto it = merged_stats_.find(board.hash128());
+                board.Pop();
+                if (it != merged_stats_.end() && it->second.n > 0) {
+                    visits->emplace_back(moves[i], it->second.n);
+                }
+            }
+            return;
+        }
+        EpochDomain::Reader reader(&epoch_domain_);
+        EpochDomain::Guard guard(&reader);
+        auto root_node = root_.load(std::memory_order_acquire)->node;
+        if (!root_node->inited.load(std::memory_order_acquire)) {
+            return;
+        }
+        for (int i = 0; i < root_node->child_num_; i++) {
+            auto child_node = root_node->children_[i].node.load(std::memory_order_acquire);
+            if (child_node != nullptr) {
+                visits->emplace_back(root_node->children_[i].move, child_node->N());
             }
-            move_node = &(*std::max_element(node->move2node_.begin(), node->move2node_.end(),
-                                            [is_black](const std::pair<ChessMove, std::shared_ptr<Node>> &x,
-                                                       const std::pair<ChessMove, std::shared_ptr<Node>> &y) -> bool {
-                                                return x.second->GetWinRate(is_black) <
-                                                       y.second->GetWinRate(is_black);
-                                            }));
         }
-        line << move_node->first << " (" << move_node->second->GetWinRate(is_black) << ") " << " ---> ";
-        LogPathNode(line, move_node->second.get());
+    }
+
+    template<int BOARD_SIZE>
+    int64_t MCTSEngineT<BOARD_SIZE>::GetFirstPlayoutUs() {
+        return first_playout_us_.load();
+    }
+
+    template<int BOARD_SIZE>
+    void MCTSEngineT<BOARD_SIZE>::LogPathNode(std::stringstream &line, Node<BOARD_SIZE> *node) {
+        bool is_black = node->is_black;
+        auto child = node->GetBestChild(is_black);
+        if (child == nullptr) {
+            return;
+        }
+        auto child_node = child->node.load(std::memory_order_acquire);
+        line << child->move << " (" << child_node->GetWinRate(is_black) << ") " << " ---> ";
+        LogPathNode(line, child_node);
     }
 
 
-    Node::Node(bool isBlack, MCTSEngine *engine) : is_black(isBlack), n(0), black_win_count(0), white_win_count(0),
-                                                   engine_(engine), access_cnt(0), inited(false),
-                                                   unexpanded_move_size(0), unexpanded_moves(nullptr) {
+    template<int BOARD_SIZE>
+    Node<BOARD_SIZE>::Node(bool isBlack, MCTSEngineT<BOARD_SIZE> *engine) : is_black(isBlack), init_claimed(false),
+                                                                            inited(false), child_num_(0),
+                                                                            expanded_num_(0), children_(nullptr),
+                                                                            child_n_(nullptr), child_win_(nullptr),
+                                                                            child_virtual_loss_(nullptr),
+                                                                            engine_(engine), wins_(0), draw_n_(0),
+                                                                            access_cnt(0), best_child_(nullptr) {
 
     }
 
-    void Node::UpdateValue(BoardResult res) {
-        n++;
-        if (res == BoardResult::BLACK_WIN) {
-            black_win_count++;
-        } else if (res == BoardResult::WHITE_WIN) {
-            white_win_count++;
+    template<int BOARD_SIZE>
+    Node<BOARD_SIZE> *Node<BOARD_SIZE>::NewRoot(NodeArena *arena, bool is_black, MCTSEngineT<BOARD_SIZE> *engine) {
+        //申请两个缓存行，冷数据放在前一行的末尾，热数据从后一行的开头开始，两行都不会有其他节点
+        static_assert(offsetof(Node, wins_) <= CACHE_LINE, "cold fields must fit in one cache line");
+        static_assert(sizeof(Node) - offsetof(Node, wins_) <= CACHE_LINE, "hot fields must fit in one cache line");
+        char *lines = static_cast<char *>(arena->Allocate(2 * CACHE_LINE, CACHE_LINE));
+        return new(lines + CACHE_LINE - offsetof(Node, wins_)) Node(is_black, engine);
+    }
+
+    template<int BOARD_SIZE>
+    PlayoutStats Node<BOARD_SIZE>::GetStats() const {
+        PlayoutStats stats;
+        uint64_t wins = wins_.load(std::memory_order_relaxed);
+        stats.black_win = static_cast<int64_t>(wins >> WIN_SHIFT);
+        stats.white_win = static_cast<int64_t>(wins & ((1ULL << WIN_SHIFT) - 1));
+        stats.n = stats.black_win + stats.white_win + draw_n_.load(std::memory_order_relaxed);
+        return stats;
+    }
+
+    template<int BOARD_SIZE>
+    void Node<BOARD_SIZE>::UpdateValue(const PlayoutStats &stats) {
+        //黑白胜局数一次加上，只有有和棋时才多写一次
+        uint64_t wins = static_cast<uint64_t>(stats.black_win) << WIN_SHIFT | static_cast<uint64_t>(stats.white_win);
+        if (wins) {
+            wins_.fetch_add(wins);
+        }
+        int64_t draw = stats.n - stats.black_win - stats.white_win;
+        if (draw) {
+            draw_n_.fetch_add(draw);
         }
     }
 
-    BoardResult Node::ExpandTree(SearchCtx *ctx) {
+    template<int BOARD_SIZE>
+    void Node<BOARD_SIZE>::UpdateChildValue(int i, const PlayoutStats &stats) {
+        child_n_[i].fetch_add(stats.n, std::memory_order_release);
+        int64_t win = is_black ? stats.black_win : stats.white_win;
+        if (win) {
+            child_win_[i].fetch_add(win, std::memory_order_relaxed);
+        }
+    }
+
+    template<int BOARD_SIZE>
+    void Node<BOARD_SIZE>::SyncChildValue(int i, Node *node) {
+        //UCT2：共享节点的胜率汇总了所有父节点经过它的结果，比单条边上的更准；探索项仍按这条边的访问次数
+        PlayoutStats stats = node->GetStats();
+        if (stats.n > 0) {
+            int64_t node_win = is_black ? stats.black_win : stats.white_win;
+            child_win_[i].store(node_win * child_n_[i].load(std::memory_order_relaxed) / stats.n,
+                                std::memory_order_relaxed);
+        }
+    }
+
+    template<int BOARD_SIZE>
+    PlayoutStats Node<BOARD_SIZE>::ExpandTree(SearchCtx<BOARD_SIZE> *ctx) {
+        PlayoutStats res;
         if (ctx->board.End() != BoardResult::NOT_END) {
-            UpdateValue(ctx->board.End());
-            return ctx->board.End();
+            //终局的结果是确定的，只记一局
+            res.Add(ctx->board.End());
+            UpdateValue(res);
+            return res;
+        }
+        //其他线程正在Init或者还没有子节点发布时都不等待，直接从该节点模拟一局
+        if (!inited.load(std::memory_order_acquire)) {
+            if (init_claimed.exchange(true)) {
+                return Simulation(ctx, 1);
+            }
+            Init(ctx->board, ctx->arena);
+        }
+        if (child_num_ == 0) {
+            //棋盘下满或者禁手规则下黑棋只剩禁手点，按和棋处理
+            res.Add(BoardResult::BALANCE);
+            UpdateValue(res);
+            return res;
         }
-        auto max_move_size = BOARD_SIZE * BOARD_SIZE - ctx->board.GetMoveNums();
         int64_t index = access_cnt.fetch_add(1);
-        //init
-        if (index == 0) {
-            unexpanded_moves = new ChessMove[max_move_size];
-            Init(ctx->board);
-        }
-        while (!inited.load(std::memory_order_relaxed));
-        assert(unexpanded_move_size <= max_move_size);
-        if (index >= unexpanded_move_size) {
-            std::pair<ChessMove, std::shared_ptr<Node>> move_node;
-            {
-                common::ReadLockGuard gurad(best_move_lock_);
-                move_node = best_move_node_;
-            }
-            if (move_node.second == nullptr && index < engine_->thread_num_) {
-                bool fisrt_loop = true;
-                while (true) {
-                    if (!fisrt_loop)
-                        std::this_thread::sleep_for(std::chrono::milliseconds(10));
-                    common::ReadLockGuard gurad1(move2node_lock_);
-                    if (!move2node_.empty()) break;
-                    fisrt_loop = false;
+        if (index >= child_num_) {
+            Child *child = best_child_.load(std::memory_order_acquire);
+            //每16次访问重选一次，每次都重选会少约两成模拟次数。
+            //缓存的最优子节点上有其他线程记的虚拟败局时也要重选，否则所有线程都会挤在同一条路径上
+            const int virtual_loss = engine_->virtual_loss_;
+            if (index % 16 == 0 || child == nullptr ||
+                (virtual_loss && child_virtual_loss_[child - children_].load(std::memory_order_relaxed) > 0)) {
+                child = SelectChild(ctx->root->N());
+                if (child == nullptr) {
+                    //所有槽位都已被领走，但还没有一个发布
+                    return Simulation(ctx, 1);
                 }
+                best_child_.store(child, std::memory_order_release);
             }
-            if (index % 64 == 0 || move_node.second == nullptr) {
-                common::ReadLockGuard gurad1(move2node_lock_);
-                auto best_move = *std::max_element(move2node_.begin(), move2node_.end(),
-                                                   [](const std::pair<ChessMove, std::shared_ptr<Node>> &x,
-                                                      const std::pair<ChessMove, std::shared_ptr<Node>> &y) -> bool {
-                                                       return x.second->GetValue() < y.second->GetValue();
-                                                   });
-                common::WriteLockGuard gurad2(best_move_lock_);
-                best_move_node_ = best_move;
-                move_node = best_move;
-                if (unexpanded_moves != nullptr && move2node_.size() == unexpanded_move_size) {
-                    delete[] unexpanded_moves;
-                    unexpanded_moves = nullptr;
-                }
+            int i = static_cast<int>(child - children_);
+            auto node = child->node.load(std::memory_order_acquire);
+            assert(child->move.x != -1 && child->move.y != -1 && node);
+            ctx->board.Move(child->move);
+            child_virtual_loss_[i].fetch_add(virtual_loss, std::memory_order_relaxed);
+            res = node->ExpandTree(ctx);
+            child_virtual_loss_[i].fetch_sub(virtual_loss, std::memory_order_relaxed);
+            UpdateChildValue(i, res);
+            if (ctx->table != nullptr) {
+                SyncChildValue(i, node);
             }
-            assert(move_node.second);
-            auto &move = move_node.first;
-            auto &node = move_node.second;
-            assert(move.x != -1 && move.y != -1 && node);
-            ctx->board.Move(move);
-            auto res = node->ExpandTree(ctx);
             UpdateValue(res);
             return res;
         } else {
-            auto move = unexpanded_moves[index];
-            std::pair<ChessMove, std::shared_ptr<Node>> move_node =
-                    std::make_pair(move, std::make_shared<Node>(!is_black, engine_));
-            auto &node = move_node.second;
-            assert(move.x != -1 && move.y != -1 && node);
-            {
-                common::WriteLockGuard gurad(move2node_lock_);
-                move2node_.push_back(move_node);
+            auto &child = children_[index];
+            assert(child.move.x != -1 && child.move.y != -1);
+            ctx->board.Move(child.move);
+            //置换模式下同一局面已有节点时直接接到这个节点上，和新节点一样从它模拟一局，结果记到共享节点上。
+            //不从它继续往下展开：命中的大多是只访问过一次的叶子，展开要给它分配整组子节点槽位，内存反而比搜索树多
+            NodeArena *arena = ctx->arena;
+            Node *node = arena->New<Node>(!is_black, engine_);
+            bool transposed = false;
+            if (ctx->table != nullptr) {
+                //命中时新分配的节点就浪费了，但比先查一次再插入少加一次锁
+                auto created = node;
+                node = ctx->table->Intern(ctx->board.hash128(), node);
+                transposed = node != created;
+            }
+            const int virtual_loss = engine_->virtual_loss_;
+            //先发布再记虚拟败局，选择时统计不为0的槽位一定已经发布
+            child.node.store(node, std::memory_order_release);
+            child_virtual_loss_[index].fetch_add(virtual_loss, std::memory_order_release);
+            expanded_num_.fetch_add(1, std::memory_order_release);
+            res = node->Simulation(ctx, engine_->leaf_playouts_);
+            child_virtual_loss_[index].fetch_sub(virtual_loss, std::memory_order_relaxed);
+            UpdateChildValue(static_cast<int>(index), res);
+            if (transposed) {
+                SyncChildValue(static_cast<int>(index), node);
             }
-            ctx->board.Move(move);
-            auto res = node->Simulation(ctx);
             UpdateValue(res);
             return res;
         }
     }
 
-    BoardResult Node::Simulation(SearchCtx *ctx) {
-        thread_local int coords[BOARD_SIZE * BOARD_SIZE];
-        thread_local bool coords_inited = false;
-        thread_local std::random_device rd;  // 随机数种子
-        thread_local std::minstd_rand rng(rd());  // 随机数生成器
-        if (!coords_inited) {
-            for (int i = 0; i < BOARD_SIZE * BOARD_SIZE; i++) {
-                coords[i] = i;
+    template<int BOARD_SIZE>
+    PlayoutStats Node<BOARD_SIZE>::Simulation(SearchCtx<BOARD_SIZE> *ctx, int playout_num) {
+        auto &board = ctx->board;
+        //每局从叶子局面的副本重新开始。按落子栈Pop回去的代价和落子差不多，复制整个棋盘更便宜
+        thread_local ChessBoardStateT<BOARD_SIZE> leaf;
+        if (playout_num > 1) {
+            leaf = board;
+        }
+        PlayoutStats stats;
+        for (int i = 0; i < playout_num; i++) {
+            if (i > 0) {
+                board = leaf;
+            }
+            switch (engine_->rollout_policy_) {
+                case ROLLOUT_LOCAL:
+                    stats.Add(LocalRollout(&board));
+                    break;
+                case ROLLOUT_DECISIVE:
+                    stats.Add(DecisiveRollout(&board));
+                    break;
+                default:
+                    stats.Add(RandomRollout(&board));
+                    break;
             }
-            coords_inited = true;
         }
-        std::shuffle(coords, coords + BOARD_SIZE * BOARD_SIZE, rng);
+        UpdateValue(stats);
+        return stats;
+    }
+
+    template<int BOARD_SIZE>
+    BoardResult Node<BOARD_SIZE>::RandomRollout(ChessBoardStateT<BOARD_SIZE> *board) {
+        //每一步从空点集合中等概率抽一个，等价于对空点洗牌后依次落子，但只为实际下出的棋子付出代价
         bool black_turn = is_black;
-        auto &board = ctx->board;
-        int index = 0;
-        while (board.End() == BoardResult::NOT_END && index < BOARD_SIZE * BOARD_SIZE) {
-            int x = coords[index] / BOARD_SIZE;
-            int y = coords[index] % BOARD_SIZE;
-            if (board.GetChessAt(x, y) != Chess::EMPTY) {
-                index++;
-                continue;
+        while (board->End() == BoardResult::NOT_END && board->GetMoveNums() < BOARD_SIZE * BOARD_SIZE) {
+            auto move = board->getRandMove(black_turn);
+            if (move.x == -1) {
+                break; //禁手规则下黑棋只剩禁手点，按和棋处理
+            }
+            board->Move(move);
+            black_turn = !black_turn;
+        }
+        return board->End();
+    }
+
+    template<int BOARD_SIZE>
+    BoardResult Node<BOARD_SIZE>::DecisiveRollout(ChessBoardStateT<BOARD_SIZE> *board) {
+        //成五点和对方的成五点都由威胁点跟踪增量维护，每步只多两次O(1)的查询
+        assert(board->IsThreatTracking());
+        bool black_turn = is_black;
+        while (board->End() == BoardResult::NOT_END && board->GetMoveNums() < BOARD_SIZE * BOARD_SIZE) {
+            ChessMove move;
+            if (board->HasThreat(black_turn, ChessBoardStateT<BOARD_SIZE>::THREAT_FIVE)) {
+                move = board->GetThreatMove(black_turn, ChessBoardStateT<BOARD_SIZE>::THREAT_FIVE);
+            } else if (board->HasThreat(!black_turn, ChessBoardStateT<BOARD_SIZE>::THREAT_FIVE)) {
+                move = board->GetThreatMove(!black_turn, ChessBoardStateT<BOARD_SIZE>::THREAT_FIVE);
+                move.is_black = black_turn;
+                if (black_turn && board->IsForbidden(move.x, move.y)) {
+                    move = board->getRandMove(black_turn); //禁手规则下黑棋堵不住，随便下一步
+                }
+            } else {
+                move = board->getRandMove(black_turn);
+            }
+            if (move.x == -1) {
+                break;
             }
-            ChessMove move(black_turn, x, y);
-            board.Move(move);
+            board->Move(move);
             black_turn = !black_turn;
-            index++;
         }
-        BoardResult end = board.End();
-        UpdateValue(end);
-        return end;
+        return board->End();
     }
 
-    double Node::GetValue() {
-        double dw, dn, total_n;
+    template<int BOARD_SIZE>
+    double Node<BOARD_SIZE>::GetValue(int64_t total_n) {
+        double dw, dn;
         {
+            PlayoutStats stats = GetStats();
             if (!is_black) {
-                dw = static_cast<double >(black_win_count);
+                dw = static_cast<double >(stats.black_win);
             } else {
-                dw = static_cast<double >(white_win_count);
+                dw = static_cast<double >(stats.white_win);
             }
-            dn = static_cast<double >(n);
+            dn = static_cast<double >(stats.n);
             if (dn == 0) {
                 return 0;
             }
         }
-        total_n = static_cast<double >(engine_->root_node_->n);
-        return dw / dn + engine_->C * std::sqrt(std::log(total_n) / dn);
+        return dw / dn + engine_->C * std::sqrt(std::log(static_cast<double >(total_n)) / dn);
+    }
+
+    template<int BOARD_SIZE>
+    typename Node<BOARD_SIZE>::Child *Node<BOARD_SIZE>::SelectChild(int64_t total_n) {
+        //槽位可能乱序发布，还没有发布的槽位统计都为0，不会被选中
+        double explore = engine_->C * std::sqrt(std::log(static_cast<double>(std::max<int64_t>(total_n, 1))));
+        int best = UcbKernel::SelectBest(child_n_, child_win_, child_virtual_loss_, child_num_, explore);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        return best >= 0 ? &children_[best] : nullptr;
+    }
+
+    template<int BOARD_SIZE>
+    typename Node<BOARD_SIZE>::Child *Node<BOARD_SIZE>::GetBestChild(bool is_black) {
+        if (!inited.load(std::memory_order_acquire)) {
+            return nullptr;
+        }
+        Child *best = nullptr;
+        double best_rate = 0;
+        for (int i = 0; i < child_num_; i++) {
+            auto node = children_[i].node.load(std::memory_order_acquire);
+            if (node == nullptr) {
+                continue;
+            }
+            double rate = node->GetWinRate(is_black);
+            if (best == nullptr || rate > best_rate) {
+                best = &children_[i];
+                best_rate = rate;
+            }
+        }
+        return best;
     }
 
-    double Node::GetWinRate(bool black_rate) {
+    template<int BOARD_SIZE>
+    double Node<BOARD_SIZE>::GetWinRate(bool black_rate) {
         double dw, dn;
         {
+            PlayoutStats stats = GetStats();
             if (black_rate) {
-                dw = static_cast<double >(black_win_count);
+                dw = static_cast<double >(stats.black_win);
             } else {
-                dw = static_cast<double >(white_win_count);
+                dw = static_cast<double >(stats.white_win);
             }
-            dn = static_cast<double >(n);
+            dn = static_cast<double >(stats.n);
             if (dn == 0) {
                 return 0;
             }
@@ -304,67 +990,152 @@ namespace gomoku {
         return dw / dn;
     }
 
-    BoardResult Node::Simulation2(SearchCtx *ctx) {
-        thread_local int coords[BOARD_SIZE * BOARD_SIZE];
-        thread_local bool coords_inited = false;
-        thread_local std::random_device rd;  // 随机数种子
-        thread_local std::minstd_rand rng(rd());  // 随机数生成器
-        if (!coords_inited) {
-            for (int i = 0; i < BOARD_SIZE * BOARD_SIZE; i++) {
-                coords[i] = i;
-            }
-            coords_inited = true;
-        }
-        std::shuffle(coords, coords + BOARD_SIZE * BOARD_SIZE, rng);
-        bool vis[BOARD_SIZE * BOARD_SIZE] = {false};
+    template<int BOARD_SIZE>
+    BoardResult Node<BOARD_SIZE>::LocalRollout(ChessBoardStateT<BOARD_SIZE> *board) {
+        //从空点里抽，抽到离已有棋子太远的点就重抽，等价于在候选点里等概率抽；
+        //连续几次都抽不中时候选点已经很少，改为列出全部候选点再抽
+        const int MAX_RETRY = 8;
+        auto &rng = ThreadRandom();
         bool black_turn = is_black;
-        auto &board = ctx->board;
-        int index = 0;
-        while (board.End() == BoardResult::NOT_END && board.GetMoveNums() < BOARD_SIZE * BOARD_SIZE) {
-            assert(index < BOARD_SIZE * BOARD_SIZE);
-            if (vis[index]) {
-                index = (index + 1) % (BOARD_SIZE * BOARD_SIZE);
-                continue;
-            }
-            int x = coords[index] / BOARD_SIZE;
-            int y = coords[index] % BOARD_SIZE;
-            if (board.GetChessAt(x, y) != Chess::EMPTY) {
-                index = (index + 1) % (BOARD_SIZE * BOARD_SIZE);
-                vis[index] = true;
-                continue;
+        while (board->End() == BoardResult::NOT_END && board->GetMoveNums() < BOARD_SIZE * BOARD_SIZE) {
+            ChessMove move;
+            for (int i = 0; i < MAX_RETRY; i++) {
+                move = board->getRandMove(black_turn);
+                if (move.x == -1 || !board->IsCutMove(move)) {
+                    break;
+                }
+                move = ChessMove();
             }
-            ChessMove move(black_turn, x, y);
-            if (!board.IsCutMove(move)) {
-                board.Move(move);
-                black_turn = !black_turn;
-                vis[index] = true;
+            if (move.x == -1) {
+                ChessMove moves[BOARD_SIZE * BOARD_SIZE];
+                int move_num = GenerateMoves(*board, black_turn, moves);
+                if (move_num == 0) {
+                    break; //禁手规则下黑棋只剩禁手点，按和棋处理
+                }
+                move = moves[rng.Below(move_num)];
             }
-            index = (index + 1) % (BOARD_SIZE * BOARD_SIZE);
+            board->Move(move);
+            black_turn = !black_turn;
+        }
+        return board->End();
+    }
+
+    template<int BOARD_SIZE>
+    void Node<BOARD_SIZE>::Init(const ChessBoardStateT<BOARD_SIZE> &board, NodeArena *arena) {
+        ChessMove moves[BOARD_SIZE * BOARD_SIZE];
+        int move_num = GenerateMoves(board, is_black, moves);
+        children_ = arena->NewArray<Child>(move_num);
+        for (int i = 0; i < move_num; i++) {
+            children_[i].move = moves[i];
         }
-        BoardResult end = board.End();
-        UpdateValue(end);
-        return end;
+        AllocChildStats(arena, move_num);
+        child_num_ = move_num;
+        inited.store(true, std::memory_order_release);
     }
 
-    Node::~Node() {
-        if (unexpanded_moves) {
-            delete[] unexpanded_moves;
+    template<int BOARD_SIZE>
+    int Node<BOARD_SIZE>::GenerateMoves(const ChessBoardStateT<BOARD_SIZE> &board, bool is_black, ChessMove *moves) {
+        int move_num = board.GetCandidateMoves(is_black, moves);
+        if (board.GetMoveNums() == 0) {
+            moves[move_num++] = {is_black, BOARD_SIZE / 2, BOARD_SIZE / 2};
         }
+        return move_num;
     }
 
-    void Node::Init(const ChessBoardState &board) {
-        for (int i = 0; i < BOARD_SIZE; i++) {
-            for (int j = 0; j < BOARD_SIZE; j++) {
-                if (board.GetChessAt(i, j) == Chess::EMPTY && !board.IsCutMove({is_black, i, j})) {
-                    unexpanded_moves[unexpanded_move_size++] = {is_black, i, j};
+    template<int BOARD_SIZE>
+    void Node<BOARD_SIZE>::AllocChildStats(NodeArena *arena, int child_num) {
+        int padded = UcbKernel::PaddedSize(child_num);
+        child_n_ = arena->NewArray<std::atomic<int64_t>>(padded);
+        child_win_ = arena->NewArray<std::atomic<int64_t>>(padded);
+        child_virtual_loss_ = arena->NewArray<std::atomic<int64_t>>(padded);
+    }
+
+    template<int BOARD_SIZE>
+    Node<BOARD_SIZE> *Node<BOARD_SIZE>::CopyTo(NodeArena *arena, NodeTable<Node> *table,
+                                               ChessBoardStateT<BOARD_SIZE> *board, int64_t *node_num, bool root) {
+        if (table != nullptr) {
+            auto copied = table->Find(board->hash128());
+            if (copied != nullptr) {
+                return copied;
+            }
+        }
+        auto node = root ? NewRoot(arena, is_black, engine_) : arena->New<Node>(is_black, engine_);
+        if (table != nullptr) {
+            table->Intern(board->hash128(), node);
+        }
+        node->wins_ = wins_.load();
+        node->draw_n_ = draw_n_.load();
+        (*node_num)++;
+        if (!inited.load(std::memory_order_acquire) || expanded_num_.load(std::memory_order_acquire) == 0) {
+            return node;
+        }
+        //已展开的排在前面，[0, expanded)都已发布，之后的访问者从第expanded个槽位接着展开
+        auto children = arena->NewArray<Child>(child_num_);
+        node->AllocChildStats(arena, child_num_);
+        bool copied[BOARD_SIZE * BOARD_SIZE] = {false};
+        int expanded = 0;
+        for (int i = 0; i < child_num_; i++) {
+            auto child_node = children_[i].node.load(std::memory_order_acquire);
+            if (child_node != nullptr) {
+                children[expanded].move = children_[i].move;
+                if (table != nullptr) {
+                    board->Push(children_[i].move);
                 }
+                children[expanded].node.store(child_node->CopyTo(arena, table, board, node_num),
+                                              std::memory_order_relaxed);
+                if (table != nullptr) {
+                    board->Pop();
+                }
+                node->child_n_[expanded] = child_n_[i].load();
+                node->child_win_[expanded] = child_win_[i].load();
+                copied[i] = true;
+                expanded++;
             }
         }
-        if (board.GetMoveNums() == 0) {
-            unexpanded_moves[unexpanded_move_size++] = {is_black, 7, 7};
+        for (int i = 0, rest = expanded; i < child_num_; i++) {
+            if (!copied[i]) {
+                children[rest++].move = children_[i].move;
+            }
+        }
+        node->children_ = children;
+        node->child_num_ = child_num_;
+        node->expanded_num_ = expanded;
+        node->access_cnt = expanded < child_num_ ? expanded : std::max<int64_t>(access_cnt.load(), child_num_);
+        node->init_claimed = true;
+        node->inited.store(true, std::memory_order_release);
+        return node;
+    }
+
+    template<int BOARD_SIZE>
+    void Node<BOARD_SIZE>::RefreshStats(const Node *from, std::unordered_set<const Node *> *visited) {
+        if (visited != nullptr && !visited->insert(this).second) {
+            return;
+        }
+        wins_ = from->wins_.load();
+        draw_n_ = from->draw_n_.load();
+        if (!inited.load(std::memory_order_relaxed)) {
+            return;
+        }
+        //CopyTo按from的槽位顺序把已发布的子节点排到前面，逐个对上着法即可
+        for (int i = 0, j = 0; i < from->child_num_ && j < expanded_num_.load(std::memory_order_relaxed); i++) {
+            if (from->children_[i].move != children_[j].move) {
+                continue;
+            }
+            child_n_[j] = from->child_n_[i].load();
+            child_win_[j] = from->child_win_[i].load();
+            children_[j].node.load(std::memory_order_relaxed)->RefreshStats(
+                    from->children_[i].node.load(std::memory_order_acquire), visited);
+            j++;
         }
-        inited.store(true, std::memory_order_relaxed);
     }
 
+    template
+    class MCTSEngineT<15>;
+
+    template
+    class MCTSEngineT<19>;
+
+    template
+    class MCTSEngineT<20>;
 
 }
@@ -3,64 +3,237 @@
 //
 #include <queue>
 #include "ChessBoardState.h"
+#include "NodeArena.h"
+#include "UcbKernel.h"
+#include "NodeTable.h"
+#include "EpochDomain.h"
 #include "common/task_thread_pool.h"
 #include "common/thread_pool.h"
 #include <cmath>
-#include <list>
-#include "common/rw_lock.h"
+#include <condition_variable>
+#include <mutex>
+#include <unordered_map>
+#include <unordered_set>
 
 #ifndef GOMOKU_MCTSENGINE_H
 #define GOMOKU_MCTSENGINE_H
 
 namespace gomoku {
+    /**
+     * TREE_PARALLEL：所有线程在同一棵树上搜索；ROOT_PARALLEL：每个线程搜索自己的私有树，定期把前几层的统计合并到一起
+     */
+    enum ParallelMode {
+        TREE_PARALLEL = 0,
+        ROOT_PARALLEL = 1
+    };
+
+    /**
+     * 解析并行方式tree/root，不认识时返回false
+     */
+    bool ParseParallelMode(const std::string &name, ParallelMode *mode);
+
+    /**
+     * 模拟时的走子策略。RANDOM：每步从空点中等概率抽一个；LOCAL：只在不会被IsCutMove剪掉的空点中等概率抽；
+     * DECISIVE：能一步成五就成五，否则对方能一步成五就去堵，都没有时随机，需要局面打开威胁点跟踪
+     */
+    enum RolloutPolicy {
+        ROLLOUT_RANDOM = 0,
+        ROLLOUT_LOCAL = 1,
+        ROLLOUT_DECISIVE = 2
+    };
+
+    /**
+     * 解析走子策略random/local/decisive，不认识时返回false
+     */
+    bool ParseRolloutPolicy(const std::string &name, RolloutPolicy *policy);
+
+    template<int BOARD_SIZE>
     struct SearchCtx;
 
-    class MCTSEngine;
+    template<int BOARD_SIZE>
+    class MCTSEngineT;
+
+    // 一局或者一批模拟的结果，回溯时整批加到路径上的每个节点
+    struct PlayoutStats {
+        int64_t n = 0, black_win = 0, white_win = 0;
+
+        void Add(BoardResult res);
+    };
 
+    template<int BOARD_SIZE>
     struct Node {
-        Node(bool isBlack, MCTSEngine *engine);
-        ~Node();
-        std::atomic<int64_t> n, black_win_count, white_win_count;
+        Node(bool isBlack, MCTSEngineT<BOARD_SIZE> *engine);
 
-        std::atomic<int64_t> access_cnt;
+        // 以下是冷数据：构造和Init时写好，之后只读（expanded_num_只在展开时写），经过节点的线程只读不写，可以共享缓存行
+        bool is_black;
+        std::atomic<bool> init_claimed; //第一个把它置为true的线程负责Init
         std::atomic<bool> inited;
-        ChessMove *unexpanded_moves;
-        int unexpanded_move_size;
+        int child_num_;
+        std::atomic<int> expanded_num_; //已发布的子节点个数
 
-        std::list<std::pair<ChessMove, std::shared_ptr<Node>>> move2node_;
-        common::RWLock move2node_lock_;
-        std::pair<ChessMove, std::shared_ptr<Node>> best_move_node_;
-        common::RWLock best_move_lock_;
+        // 子节点槽位：Init时按候选点个数一次分配好，第access_cnt个访问者展开第access_cnt个槽位。
+        // node写入后不再改变，选择时无锁顺序扫描。节点和槽位都分配在NodeArena里，随NodeArena整体释放
+        struct Child {
+            ChessMove move;
+            std::atomic<Node *> node{nullptr};
+        };
+        Child *children_;
+        // 子节点的统计按结构体数组另存一份，长度补齐到UcbKernel::LANES的倍数，选择时一次算出所有子节点的UCB值。
+        // child_win_是走到子节点的一方（即该节点的行棋方）的胜局数，child_virtual_loss_是正在经过子节点的线程记下的虚拟败局
+        std::atomic<int64_t> *child_n_, *child_win_, *child_virtual_loss_;
+        MCTSEngineT<BOARD_SIZE> *engine_;
 
-        bool is_black;
-        MCTSEngine *engine_;
+        // 以下是热数据：每次经过或回溯都要写，放在最后，根节点的热数据单独占一个缓存行（见NewRoot）。
+        // 黑白胜局数打包在一个字里，高32位黑棋、低32位白棋，回溯时一次fetch_add同时更新，读到的两者总是一致的；
+        // 每方最多记2^32-1局。和棋很少见，另记在draw_n_里，访问次数n=黑胜+白胜+和棋
+        std::atomic<uint64_t> wins_;
+        std::atomic<int64_t> draw_n_;
+        std::atomic<int64_t> access_cnt;
+        std::atomic<Child *> best_child_;
+
+        static const int WIN_SHIFT = 32;
+        static const size_t CACHE_LINE = 64;
+
+        //在arena里新建根节点：所有线程每次搜索都要写根节点的热数据，让它独占一个缓存行，不和别的节点或者自己的冷数据共用
+        static Node *NewRoot(NodeArena *arena, bool is_black, MCTSEngineT<BOARD_SIZE> *engine);
+
+        int64_t BlackWin() const { return static_cast<int64_t>(wins_.load(std::memory_order_relaxed) >> WIN_SHIFT); }
+
+        int64_t WhiteWin() const {
+            return static_cast<int64_t>(wins_.load(std::memory_order_relaxed) & ((1ULL << WIN_SHIFT) - 1));
+        }
 
-        void UpdateValue(BoardResult res);
+        PlayoutStats GetStats() const; //同一时刻的黑白胜局数，和访问次数之间可能差正在回溯的几局
 
-        double GetValue();
+        int64_t N() const { return GetStats().n; }
+
+        void UpdateValue(const PlayoutStats &stats);
+
+        void UpdateChildValue(int i, const PlayoutStats &stats);
+
+        void SyncChildValue(int i, Node *node); //置换模式下把第i条边的胜局数按共享子节点的胜率重算
+
+        double GetValue(int64_t total_n); //total_n为根节点的访问次数
 
         double GetWinRate(bool black_rate);
 
-        BoardResult ExpandTree(SearchCtx *ctx);//需要确保最后能还原ctx中的内容用于下一次搜索
-        BoardResult Simulation(SearchCtx *ctx); //黑棋赢则返回1否则返回0
-        BoardResult Simulation2(SearchCtx *ctx);
-        void Init(const ChessBoardState &borad);
+        Child *SelectChild(int64_t total_n); //按UCB值选出最好的已展开子节点，还没有子节点时返回nullptr
+
+        Child *GetBestChild(bool is_black); //按is_black一方的胜率选出最好的已展开子节点，还没有子节点时返回nullptr
+
+        PlayoutStats ExpandTree(SearchCtx<BOARD_SIZE> *ctx);//需要确保最后能还原ctx中的内容用于下一次搜索
+
+        //从当前局面模拟playout_num局，每局结束后退回到当前局面再开始下一局，结果一次记到该节点上
+        PlayoutStats Simulation(SearchCtx<BOARD_SIZE> *ctx, int playout_num);
+
+        //以下按各自的走子策略从board下完一局，该节点的行棋方先走，返回结果
+        BoardResult RandomRollout(ChessBoardStateT<BOARD_SIZE> *board);
+
+        BoardResult LocalRollout(ChessBoardStateT<BOARD_SIZE> *board);
+
+        BoardResult DecisiveRollout(ChessBoardStateT<BOARD_SIZE> *board);
+        void Init(const ChessBoardStateT<BOARD_SIZE> &borad, NodeArena *arena);
+
+        //is_black一方在board上的候选着法，空棋盘时加上天元，返回着法个数
+        static int GenerateMoves(const ChessBoardStateT<BOARD_SIZE> &board, bool is_black, ChessMove *moves);
+
+        void AllocChildStats(NodeArena *arena, int child_num);
+
+        /**
+         * 把以该节点为根的子树拷到arena里，返回新的根。已展开的子节点排到槽位前面，拷贝时仍在进行的展开会被丢掉；
+         * 一个子节点都没有展开完的节点拷成未初始化的叶子。node_num累加拷贝的节点个数。
+         * table不为空时（置换模式）board是该节点的局面，共享的节点只拷一次并登记到table里
+         */
+        Node *CopyTo(NodeArena *arena, NodeTable<Node> *table, ChessBoardStateT<BOARD_SIZE> *board, int64_t *node_num,
+                     bool root = false); //root为true时新的根用NewRoot分配
+
+        /**
+         * 该节点是from经CopyTo拷出来且还没有发布时，把from子树上拷贝之后新增的统计补过来（重新读一遍from的统计），
+         * 拷贝之后才展开的节点不补。visited不为空时（置换模式）共享的节点只补一次
+         */
+        void RefreshStats(const Node *from, std::unordered_set<const Node *> *visited);
     };
 
+    template<int BOARD_SIZE>
     struct SearchCtx {
-        ChessBoardState board;
+        ChessBoardStateT<BOARD_SIZE> board;
+        Node<BOARD_SIZE> *root; //本次搜索开始时的根节点
+        NodeArena *arena; //本次搜索新建的节点都分配在这里
+        NodeTable<Node<BOARD_SIZE>> *table; //置换模式下按局面共享节点的表，否则为空
+        int64_t root_epoch; //本次搜索开始时根节点的编号，每次换根加一
     };
 
-    class MCTSEngine {
-        friend Node;
+    template<int BOARD_SIZE>
+    class MCTSEngineT {
+        friend struct Node<BOARD_SIZE>;
     public:
-        explicit MCTSEngine(int thread_num, double explore_c = std::sqrt(2));
+        explicit MCTSEngineT(int thread_num, double explore_c = std::sqrt(2));
+
+        ~MCTSEngineT();
+
+        bool StartSearch(const ChessBoardStateT<BOARD_SIZE> &state, bool black_first); //中断上一次的搜索
 
-        bool StartSearch(const ChessBoardState &state, bool black_first);
+        void SetRuleSet(RuleSet rule_set); //在StartSearch之前调用，搜索时的局面都使用该规则
 
-        bool Action(ChessMove move);
+        void SetHugePages(bool huge_pages); //在StartSearch之前调用，节点内存池是否使用透明大页
 
-        ChessMove GetResult(); //获取搜索结果,该函数不应该中断搜索，可以反复调用获取最新的搜索结果
+        /**
+         * 在StartSearch之前调用。线程经过一个节点时先给它记virtual_loss局虚拟败局，回溯时撤销，
+         * 让同时搜索的其他线程选到别的节点；默认1，与virtual_loss参数一致，0表示关闭
+         */
+        void SetVirtualLoss(int virtual_loss);
+
+        /**
+         * 在StartSearch之前调用。打开后不同着法顺序到达的同一局面共享一个节点，搜索树变成有向无环图；
+         * 边上另记访问次数用于探索项，胜率取共享节点的
+         */
+        void SetTransposition(bool transposition);
+
+        /**
+         * 在StartSearch之前调用。ROOT_PARALLEL下每个线程各自建树，线程之间不共享节点，
+         * 每ROOT_SYNC_INTERVAL_MS毫秒和GetResult时把各自前几层的统计合并；每次换根各线程重新建树，置换模式不生效
+         */
+        void SetParallelMode(ParallelMode mode);
+
+        /**
+         * 在StartSearch之前调用，只对ROOT_PARALLEL生效。根节点往下share_plies层的节点把其他线程的统计加到自己树上，
+         * 影响各线程的选择；0表示只合并根节点的子节点用于给出结果，各线程独立搜索
+         */
+        void SetSharePlies(int share_plies);
+
+        /**
+         * 在StartSearch之前调用。每展开一个新叶子从它连续模拟leaf_playouts局，汇总后只回溯一次，
+         * 分摊选择、分配节点和回溯的开销；默认1
+         */
+        void SetLeafPlayouts(int leaf_playouts);
+
+        void SetRolloutPolicy(RolloutPolicy policy); //在StartSearch之前调用，默认ROLLOUT_RANDOM
+
+        /**
+         * 在StartSearch之前调用。非0时第i个搜索线程用seed+i给自己的随机数生成器播种，单线程搜索可以复现；
+         * 0表示每个线程用random_device播种
+         */
+        void SetSeed(uint64_t seed);
+
+        /**
+         * 在StartSearch之前调用。使用外部的常驻线程池（已经InitPersistent并Start，线程数不少于thread_num），
+         * 可以和其他引擎共用，同一时间只能有一个引擎在搜索；不设置时第一次StartSearch创建自己的常驻线程池，
+         * 之后每次搜索复用这些线程，Stop只让它们回去休眠
+         */
+        void SetThreadPool(common::ThreadPool *pool);
+
+        void SetPinThreads(bool pin_threads); //在第一次StartSearch之前调用，自己的线程池是否把线程绑定到CPU上
+
+        bool Action(ChessMove move); //只换根，耗时与树的大小无关；保留的子树随后由后台线程拷到新的NodeArena
+
+        int64_t GetActionUs(); //上一次Action的微秒数，包括终局时Action里调用的Stop，还没有调用过时返回-1
+
+        size_t GetMemoryBytes(); //当前搜索树占用的内存，包括置换表
+
+        int64_t GetTranspositionHits(); //置换模式下展开时命中已有节点的次数
+
+        //获取搜索结果,该函数不应该中断搜索，可以反复调用获取最新的搜索结果。win_rate不为空时写入该着法的胜率
+        ChessMove GetResult(double *win_rate = nullptr);
         bool Stop();
 
         void DumpTree();
@@ -69,22 +242,109 @@ namespace gomoku {
 
         void LogPath();
 
+        void GetRootVisits(std::vector<std::pair<ChessMove, int64_t>> *visits); //根节点各个已展开子节点的访问次数
+
+        int64_t GetFirstPlayoutUs(); //从设置当前根节点到所有线程都完成第一次模拟的微秒数，还没完成时返回-1
+
+        static const int ROOT_SYNC_INTERVAL_MS = 10;
+
     private:
+        // 当前的根：发布之后不再修改，换根和整理时整体替换成新的。搜索线程在epoch_domain_的临界区里直接用裸指针，
+        // 替换下来的放进retired_，等临界区里的读者都退出后释放；arena和table由引用它们的RootState共同持有
+        struct RootState {
+            ChessBoardStateT<BOARD_SIZE> board;
+            Node<BOARD_SIZE> *node;
+            std::shared_ptr<NodeArena> arena;
+            std::shared_ptr<NodeTable<Node<BOARD_SIZE>>> table; //置换模式下与arena一起替换，否则为空
+            int64_t epoch; //root_epoch_
+            uint64_t start_us; //设置这个根的时间，整理后不变
+        };
+
+        // 根并行模式下每个线程记下的某个局面的同步状态：published是已经合并出去的本线程统计，injected是已经加到本线程树上的其他线程统计
+        struct SyncState {
+            Node<BOARD_SIZE> *node = nullptr;
+            PlayoutStats published, injected;
+        };
+
+        using SyncStates = std::unordered_map<ZobristKey128, SyncState, ZobristKey128Hash>;
+
         const double C;
         std::atomic<bool> stop_;
-        common::ThreadPool threadPool;
-        common::RWLock root_lock_;
-        std::shared_ptr<Node> root_node_;
-        std::shared_ptr<ChessBoardState> root_board_;
+        common::ThreadPool threadPool; //没有SetThreadPool时用的常驻线程池
+        common::ThreadPool *pool_; //搜索线程所在的线程池
+        uint64_t search_job_; //本次搜索在pool_里的任务编号
+        bool pin_threads_;
+        // 整棵树都分配在当前根的arena里。Action在原来的arena里直接换根，后台线程再把保留的子树拷到新的NodeArena，
+        // 旧的在引用它的RootState都回收之后整体释放
+        std::atomic<RootState *> root_;
+        std::mutex root_update_lock_; //Action和CompactTree替换root_时互斥，读者不加锁
+        EpochDomain epoch_domain_;
+        std::mutex retired_lock_;
+        std::vector<RootState *> retired_;
         int thread_num_;
+        RuleSet rule_set_;
+        bool huge_pages_;
+        int virtual_loss_;
+        bool transposition_;
+        ParallelMode parallel_mode_;
+        int share_plies_;
+        int leaf_playouts_;
+        RolloutPolicy rollout_policy_;
+        uint64_t seed_;
+        std::atomic<int> worker_seq_; //已经启动的搜索线程数，用于给各线程分配不同的种子
+        // 每次StartSearch、Action换根时重置，用于统计所有线程完成第一次模拟的耗时
+        std::atomic<int64_t> root_epoch_;
+        std::atomic<int> first_playout_threads_;
+        std::atomic<int64_t> first_playout_us_;
+        std::atomic<int64_t> action_us_;
+        // 根并行模式下合并后的统计，只保存当前根往下max(share_plies_, 1)层的局面，换根时清空
+        std::mutex merged_lock_;
+        std::condition_variable merged_cv_;
+        std::unordered_map<ZobristKey128, PlayoutStats, ZobristKey128Hash> merged_stats_;
+        int64_t merged_epoch_; //merged_stats_对应的root_epoch_，旧根上的统计不再合并进来
+        std::atomic<int64_t> sync_request_; //GetResult每次加一，搜索线程看到后立即合并一次
+        int sync_acks_; //响应了最新一次sync_request_的线程数
+        common::TaskThreadPool<> reclaim_pool_; //整理换根后的搜索树，第一次StartSearch时启动，析构时才停止；放在最后最先析构
 
         void LoopExpandTree();
 
-        void PrintNode(std::ostream &os, Node *node, ChessMove move, int deep);
+        void LoopRootParallel(); //根并行模式下的搜索线程
+
+        void SeedWorker(); //搜索线程开始时调用
+
+        void FinishPlayout(int64_t epoch, uint64_t root_start_us, int64_t *done_epoch); //统计所有线程完成第一次模拟的耗时
+
+        //把私有树上的统计合并到merged_stats_，share_plies_>0时再把其他线程的统计加到私有树上
+        void SyncRootWorker(int64_t epoch, Node<BOARD_SIZE> *root, ChessBoardStateT<BOARD_SIZE> *board,
+                            SyncStates *states, int64_t *request);
+
+        void SyncNode(Node<BOARD_SIZE> *node, Node<BOARD_SIZE> *parent, int slot, ChessBoardStateT<BOARD_SIZE> *board,
+                      int depth, SyncStates *states);
+
+        //持有merged_lock_时调用，按合并后的统计选出board上is_black一方胜率最高的着法，没有统计时返回false
+        bool GetMergedBest(ChessBoardStateT<BOARD_SIZE> *board, bool is_black, ChessMove *move, double *rate);
+
+        void RequestSync(std::unique_lock<std::mutex> *lock); //让所有搜索线程立即合并一次，最多等ROOT_SYNC_INTERVAL_MS毫秒
 
-        void LogPathNode(std::stringstream &line, Node *node);
+        void CompactTree(int64_t epoch); //root_epoch_还是epoch时把当前根的子树拷到新的NodeArena
+
+        void PublishRoot(RootState *state); //持有root_update_lock_时调用，发布新的根并把旧的放进retired_
+
+        void ReclaimRetired(); //等临界区里的读者退出后释放retired_里的根，不能在临界区里调用
+
+        void PrintNode(std::ostream &os, Node<BOARD_SIZE> *node, ChessMove move, int deep, int64_t total_n);
+
+        void LogPathNode(std::stringstream &line, Node<BOARD_SIZE> *node);
 
     };
+
+    extern template class MCTSEngineT<15>;
+
+    extern template class MCTSEngineT<19>;
+
+    extern template class MCTSEngineT<20>;
+
+    using MCTSEngine = MCTSEngineT<BOARD_SIZE>;
 };
 
 #endif //GOMOKU_MCTSENGINE_H
@@ -11,9 +11,14 @@
 
 DEFINE_bool(human_first, true, "");
 
-void EngineManualTest() {
-    gomoku::MCTSEngine engine(gomoku::FLAGS_thread_num);
-    gomoku::ChessBoardState board;
+template<int BOARD_SIZE>
+bool EngineManualTest(gomoku::RuleSet rule_set) {
+    gomoku::MCTSEngineT<BOARD_SIZE> engine(gomoku::FLAGS_thread_num);
+    if (!gomoku::ConfigureFromFlags(&engine)) {
+        return false;
+    }
+    gomoku::ChessBoardStateT<BOARD_SIZE> board;
+    board.SetRuleSet(rule_set);
     bool is_black = FLAGS_human_first;
     engine.StartSearch(board, is_black);
     std::atomic<bool> stop(false);
@@ -31,6 +36,10 @@ void EngineManualTest() {
             int x, y;
             std::cin >> x >> y;
             LOG(INFO) << "user move x:" << x << "y:" << y;
+            if (board.IsForbidden(x, y)) {
+                std::cout << "forbidden move, please enter another one" << std::endl;
+                continue;
+            }
             board.Move(gomoku::ChessMove(is_black, x, y));
             engine.Action(gomoku::ChessMove(is_black, x, y));
         } else {
@@ -46,6 +55,7 @@ void EngineManualTest() {
     engine.Stop();
     stop = true;
     t.join();
+    return true;
 }
 
 int main(int argc, char *argv[]) {
@@ -54,5 +64,17 @@ int main(int argc, char *argv[]) {
     google::InitGoogleLogging("ManualTest");
     FLAGS_log_dir = ".";
     FLAGS_v = 2;
-    EngineManualTest();
+    gomoku::RuleSet rule_set;
+    if (!gomoku::ParseRuleSet(gomoku::FLAGS_rule, &rule_set)) {
+        LOG(ERROR) << "unsupported rule: " << gomoku::FLAGS_rule;
+        return -1;
+    }
+    bool ok = true;
+    if (!gomoku::WithBoardSize(gomoku::FLAGS_board_size, [rule_set, &ok](auto size) {
+        ok = EngineManualTest<decltype(size)::value>(rule_set);
+    })) {
+        LOG(ERROR) << "unsupported board_size: " << gomoku::FLAGS_board_size;
+        return -1;
+    }
+    return ok ? 0 : -1;
 }
\ No newline at end of file
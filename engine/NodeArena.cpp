@@ -0,0 +1,83 @@
+//
+// Created by zrr on 2024/3/12.
+//
+
+#include "NodeArena.h"
+#include <atomic>
+#include <cassert>
+#include <cstdlib>
+#include "glog/logging.h"
+
+#ifdef __linux__
+#include <sys/mman.h>
+#endif
+
+namespace gomoku {
+
+    namespace {
+        std::atomic<uint64_t> next_arena_id(1);
+
+        //线程当前分配用的块，arena_id为0表示还没有
+        struct BlockCursor {
+            uint64_t arena_id;
+            char *cur, *end;
+        };
+
+        thread_local BlockCursor cursor = {0, nullptr, nullptr};
+    }
+
+    NodeArena::NodeArena(bool huge_pages) : id_(next_arena_id.fetch_add(1)), huge_pages_(huge_pages) {
+
+    }
+
+    NodeArena::~NodeArena() {
+        for (auto block: blocks_) {
+            free(block);
+        }
+    }
+
+    void *NodeArena::Allocate(size_t size, size_t align) {
+        assert(size <= BLOCK_SIZE);
+        if (cursor.arena_id == id_) {
+            char *p = reinterpret_cast<char *>((reinterpret_cast<uintptr_t>(cursor.cur) + align - 1) & ~(align - 1));
+            if (p + size <= cursor.end) {
+                cursor.cur = p + size;
+                return p;
+            }
+        }
+        //当前块剩下的空间直接丢弃。malloc只保证16字节对齐，按缓存行对齐时新块的起始地址也要对齐
+        char *block = NewBlock();
+        char *p = reinterpret_cast<char *>((reinterpret_cast<uintptr_t>(block) + align - 1) & ~(align - 1));
+        assert(p + size <= block + BLOCK_SIZE);
+        cursor = {id_, p + size, block + BLOCK_SIZE};
+        return p;
+    }
+
+    char *NodeArena::NewBlock() {
+        void *block = nullptr;
+        if (huge_pages_) {
+            if (posix_memalign(&block, BLOCK_SIZE, BLOCK_SIZE) != 0) {
+                block = nullptr;
+            }
+#ifdef MADV_HUGEPAGE
+            if (block != nullptr && madvise(block, BLOCK_SIZE, MADV_HUGEPAGE) != 0) {
+                LOG(WARNING) << "madvise MADV_HUGEPAGE failed";
+            }
+#endif
+        } else {
+            block = malloc(BLOCK_SIZE);
+        }
+        if (block == nullptr) {
+            LOG(ERROR) << "allocate node block failed, block num: " << blocks_.size();
+            throw std::bad_alloc();
+        }
+        std::lock_guard<std::mutex> guard(blocks_lock_);
+        blocks_.push_back(block);
+        return static_cast<char *>(block);
+    }
+
+    size_t NodeArena::GetBlockNum() {
+        std::lock_guard<std::mutex> guard(blocks_lock_);
+        return blocks_.size();
+    }
+}
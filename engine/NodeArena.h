@@ -0,0 +1,59 @@
+//
+// Created by zrr on 2024/3/12.
+//
+#include <cstddef>
+#include <stdint.h>
+#include <mutex>
+#include <new>
+#include <utility>
+#include <vector>
+
+#ifndef GOMOKU_NODEARENA_H
+#define GOMOKU_NODEARENA_H
+namespace gomoku {
+    /**
+     * 搜索树节点的内存池：按BLOCK_SIZE大小的块向系统申请，每个线程在自己当前的块里顺序分配，不加锁，
+     * 只有换块时才加锁登记。分配出去的内存不单独释放，析构时所有块一起归还，分配的对象也不会被析构。
+     * huge_pages为true时块按BLOCK_SIZE对齐并建议内核使用透明大页
+     */
+    class NodeArena {
+    public:
+        static const size_t BLOCK_SIZE = 2 << 20;
+
+        explicit NodeArena(bool huge_pages = false);
+
+        ~NodeArena();
+
+        NodeArena(const NodeArena &) = delete;
+
+        NodeArena &operator=(const NodeArena &) = delete;
+
+        void *Allocate(size_t size, size_t align);
+
+        template<typename T, typename... Args>
+        T *New(Args &&... args) {
+            return new(Allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+        }
+
+        template<typename T>
+        T *NewArray(size_t num) {
+            T *array = static_cast<T *>(Allocate(sizeof(T) * num, alignof(T)));
+            for (size_t i = 0; i < num; i++) {
+                new(array + i) T();
+            }
+            return array;
+        }
+
+        size_t GetBlockNum();
+
+    private:
+        const uint64_t id_; //全局唯一，线程据此判断自己当前的块是否属于这个NodeArena
+        const bool huge_pages_;
+        std::mutex blocks_lock_;
+        std::vector<void *> blocks_;
+
+        char *NewBlock();
+    };
+}
+
+#endif //GOMOKU_NODEARENA_H
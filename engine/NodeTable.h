@@ -0,0 +1,79 @@
+//
+// Created by zrr on 2024/3/15.
+//
+#include <atomic>
+#include <mutex>
+#include <unordered_map>
+#include "ChessBoardState.h"
+
+#ifndef GOMOKU_NODETABLE_H
+#define GOMOKU_NODETABLE_H
+namespace gomoku {
+    /**
+     * 按128位局面哈希保存节点的并发表，让不同着法顺序到达的同一局面共享一个节点。
+     * 按哈希高位分成SHARD_NUM段，每段一把锁，只在展开新节点时访问。表只保存指针，节点的内存归NodeArena管
+     */
+    template<typename T>
+    class NodeTable {
+    public:
+        static const int SHARD_NUM = 64;
+
+        T *Find(const ZobristKey128 &key) {
+            auto &shard = shards_[key.high % SHARD_NUM];
+            std::lock_guard<std::mutex> guard(shard.lock);
+            auto it = shard.nodes.find(key);
+            if (it == shard.nodes.end()) {
+                return nullptr;
+            }
+            hit_num_.fetch_add(1, std::memory_order_relaxed);
+            return it->second;
+        }
+
+        /**
+         * key已有节点时返回已有的，否则插入node并返回node
+         */
+        T *Intern(const ZobristKey128 &key, T *node) {
+            auto &shard = shards_[key.high % SHARD_NUM];
+            std::lock_guard<std::mutex> guard(shard.lock);
+            auto res = shard.nodes.emplace(key, node);
+            if (!res.second) {
+                hit_num_.fetch_add(1, std::memory_order_relaxed);
+            }
+            return res.first->second;
+        }
+
+        size_t Size() {
+            size_t size = 0;
+            for (auto &shard: shards_) {
+                std::lock_guard<std::mutex> guard(shard.lock);
+                size += shard.nodes.size();
+            }
+            return size;
+        }
+
+        //估算表本身占用的内存：每项一个链表节点加一个桶指针
+        size_t GetMemoryBytes() {
+            size_t bytes = 0;
+            for (auto &shard: shards_) {
+                std::lock_guard<std::mutex> guard(shard.lock);
+                bytes += shard.nodes.size() * (sizeof(std::pair<const ZobristKey128, T *>) + 2 * sizeof(void *)) +
+                         shard.nodes.bucket_count() * sizeof(void *);
+            }
+            return bytes;
+        }
+
+        int64_t GetHitNum() const { return hit_num_.load(); } //查到已有节点的次数
+
+    private:
+        struct Shard {
+            std::mutex lock;
+            std::unordered_map<ZobristKey128, T *, ZobristKey128Hash> nodes;
+            char padding[64]; //相邻两段的锁不落在同一个缓存行
+        };
+
+        Shard shards_[SHARD_NUM];
+        std::atomic<int64_t> hit_num_{0};
+    };
+}
+
+#endif //GOMOKU_NODETABLE_H
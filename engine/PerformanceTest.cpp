@@ -12,29 +12,47 @@
 #include "Evaluate.h"
 #include "MCTSEngine.h"
 #include <cmath>
+#include <random>
+#include <chrono>
+#include <vector>
+#include <memory>
+#include "common/thread_pool.h"
+#include "common/timeutility.h"
 #include "gflags/gflags.h"
 #include "common_flags.h"
 
-int main(int argc, char *argv[]) {
-    // Initialize Google’s logging library.
-    gflags::ParseCommandLineFlags(&argc, &argv, false);
-    google::InitGoogleLogging("PerformanceTest");
-    FLAGS_log_dir = ".";
-    FLAGS_v = 2;
+DEFINE_string(bench, "mcts", "mcts: 蒙特卡洛搜索次数; win_check: 五连判断位运算实现与逐格扫描实现的对比; "
+                             "virtual_loss: 1、4、16、64线程下有无虚拟败局的搜索分散程度与单线程效率; "
+                             "transposition: 搜索树与置换模式的内存占用和定下着法所需的模拟次数; "
+                             "parallel: 1、2、4、8、16线程下树并行与根并行的模拟次数和着法; "
+                             "rollout: 各走子策略每秒的模拟次数、着法稳定所需的模拟次数和胜率的收敛; "
+                             "restart: 反复开始、停止搜索时新建线程与常驻线程池的启动延迟");
 
-    gomoku::MCTSEngine engine(gomoku::FLAGS_thread_num);
-    gomoku::ChessBoardState board;
-    board.Move(gomoku::ChessMove(true, 7, 7));
-    board.Move(gomoku::ChessMove(true, 7, 8));
-    board.Move(gomoku::ChessMove(true, 7, 9));
-    board.Move(gomoku::ChessMove(false, 8, 7));
-    board.Move(gomoku::ChessMove(false, 8, 8));
+// 性能测试共用的开局局面
+template<int BOARD_SIZE>
+void SetupBenchBoard(gomoku::ChessBoardStateT<BOARD_SIZE> *board, gomoku::RuleSet rule_set) {
+    board->SetRuleSet(rule_set);
+    board->Move(gomoku::ChessMove(true, 7, 7));
+    board->Move(gomoku::ChessMove(true, 7, 8));
+    board->Move(gomoku::ChessMove(true, 7, 9));
+    board->Move(gomoku::ChessMove(false, 8, 7));
+    board->Move(gomoku::ChessMove(false, 8, 8));
 //    board.Move(gomoku::ChessMove(false,6,7));
 //    board.Move(gomoku::ChessMove(true,7,8));
 //    board.Move(gomoku::ChessMove(false,6,8));
 //    board.Move(gomoku::ChessMove(true,7,9));
 //    board.Move(gomoku::ChessMove(false,7,10));
 //    board.Move(gomoku::ChessMove(true,7,6));
+}
+
+template<int BOARD_SIZE>
+bool MCTSPerformanceTest(gomoku::RuleSet rule_set) {
+    gomoku::MCTSEngineT<BOARD_SIZE> engine(gomoku::FLAGS_thread_num);
+    if (!gomoku::ConfigureFromFlags(&engine)) {
+        return false;
+    }
+    gomoku::ChessBoardStateT<BOARD_SIZE> board;
+    SetupBenchBoard(&board, rule_set);
     engine.StartSearch(board, false);
     board.PrintOnTerminal();
     std::this_thread::sleep_for(std::chrono::seconds(gomoku::FLAGS_think_time));
@@ -42,8 +60,342 @@ int main(int argc, char *argv[]) {
     board.Move(move);
     board.PrintOnTerminal();
     std::cout << "engine move:" << move;
+    auto root_n = engine.GetRootN();
+    auto first_playout_us = engine.GetFirstPlayoutUs();
+    engine.Action(move);
     engine.Stop();
     //engine.DumpTree();
     engine.LogPath();
-    std::cout << "root_n:" << engine.GetRootN();
+    std::cout << "root_n:" << root_n << " first_playout_us:" << first_playout_us
+              << " action_us:" << engine.GetActionUs();
+    return true;
+}
+
+template<int BOARD_SIZE>
+bool VirtualLossPerformanceTest(gomoku::RuleSet rule_set) {
+    gomoku::ChessBoardStateT<BOARD_SIZE> board;
+    SetupBenchBoard(&board, rule_set);
+    auto search = [&](int thread_num, int virtual_loss, int think_ms,
+                      std::vector<std::pair<gomoku::ChessMove, int64_t>> *visits, gomoku::ChessMove *move) -> bool {
+        gomoku::MCTSEngineT<BOARD_SIZE> engine(thread_num);
+        if (!gomoku::ConfigureFromFlags(&engine)) {
+            return false;
+        }
+        engine.SetVirtualLoss(virtual_loss);
+        engine.StartSearch(board, false);
+        std::this_thread::sleep_for(std::chrono::milliseconds(think_ms));
+        engine.Stop();
+        if (visits != nullptr) {
+            engine.GetRootVisits(visits);
+        }
+        *move = engine.GetResult();
+        return true;
+    };
+    const int think_ms = gomoku::FLAGS_think_time * 1000;
+    // 单线程搜索4倍时间的结果作为参考着法，用于比较各配置的着法质量
+    gomoku::ChessMove reference;
+    if (!search(1, 0, think_ms * 4, nullptr, &reference)) {
+        return false;
+    }
+    std::cout << "reference move:" << reference << std::endl;
+    std::cout << "threads virtual_loss root_n root_n/thread expanded entropy move" << std::endl;
+    for (int thread_num: {1, 4, 16, 64}) {
+        for (int virtual_loss: {0, gomoku::FLAGS_virtual_loss}) {
+            std::vector<std::pair<gomoku::ChessMove, int64_t>> visits;
+            gomoku::ChessMove move;
+            if (!search(thread_num, virtual_loss, think_ms, &visits, &move)) {
+                return false;
+            }
+            // 根节点访问次数分布的熵（比特）衡量搜索的分散程度
+            int64_t root_n = 0;
+            for (auto &visit: visits) {
+                root_n += visit.second;
+            }
+            double entropy = 0;
+            for (auto &visit: visits) {
+                if (visit.second > 0) {
+                    double p = static_cast<double>(visit.second) / static_cast<double>(root_n);
+                    entropy -= p * std::log2(p);
+                }
+            }
+            std::cout << thread_num << " " << virtual_loss << " " << root_n << " " << root_n / thread_num << " "
+                      << visits.size() << " " << entropy << " " << move
+                      << (move.x == reference.x && move.y == reference.y ? " (=reference)" : "") << std::endl;
+            if (virtual_loss == 0 && gomoku::FLAGS_virtual_loss == 0) {
+                break;
+            }
+        }
+    }
+    return true;
+}
+
+template<int BOARD_SIZE>
+bool TranspositionPerformanceTest(gomoku::RuleSet rule_set) {
+    gomoku::ChessBoardStateT<BOARD_SIZE> board;
+    SetupBenchBoard(&board, rule_set);
+    std::cout << "mode root_n decision_n memory_mb hits move" << std::endl;
+    for (bool transposition: {false, true}) {
+        gomoku::MCTSEngineT<BOARD_SIZE> engine(gomoku::FLAGS_thread_num);
+        if (!gomoku::ConfigureFromFlags(&engine)) {
+            return false;
+        }
+        engine.SetTransposition(transposition);
+        engine.StartSearch(board, false);
+        // 每100ms取一次结果，decision_n是着法最后一次改变时的模拟次数，即定下最终着法用了多少次模拟
+        gomoku::ChessMove move;
+        int64_t decision_n = 0;
+        for (int i = 0; i < gomoku::FLAGS_think_time * 10; i++) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+            auto result = engine.GetResult();
+            if (!(result == move)) {
+                move = result;
+                decision_n = engine.GetRootN();
+            }
+        }
+        engine.Stop();
+        std::cout << (transposition ? "dag " : "tree ") << engine.GetRootN() << " " << decision_n << " "
+                  << engine.GetMemoryBytes() / (1 << 20) << " " << engine.GetTranspositionHits() << " " << move
+                  << std::endl;
+    }
+    return true;
+}
+
+template<int BOARD_SIZE>
+bool ParallelPerformanceTest(gomoku::RuleSet rule_set) {
+    gomoku::ChessBoardStateT<BOARD_SIZE> board;
+    SetupBenchBoard(&board, rule_set);
+    std::cout << "threads mode root_n root_n/thread move" << std::endl;
+    for (int thread_num: {1, 2, 4, 8, 16}) {
+        for (auto parallel_mode: {gomoku::TREE_PARALLEL, gomoku::ROOT_PARALLEL}) {
+            gomoku::MCTSEngineT<BOARD_SIZE> engine(thread_num);
+            if (!gomoku::ConfigureFromFlags(&engine)) {
+                return false;
+            }
+            engine.SetParallelMode(parallel_mode);
+            engine.StartSearch(board, false);
+            std::this_thread::sleep_for(std::chrono::seconds(gomoku::FLAGS_think_time));
+            engine.Stop();
+            // 根并行模式下root_n是合并后根节点的模拟次数，Stop时各线程已经做完最后一次合并
+            auto root_n = engine.GetRootN();
+            std::cout << thread_num << (parallel_mode == gomoku::TREE_PARALLEL ? " tree " : " root ") << root_n
+                      << " " << root_n / thread_num << " " << engine.GetResult() << std::endl;
+        }
+    }
+    return true;
+}
+
+template<int BOARD_SIZE>
+bool RolloutPerformanceTest(gomoku::RuleSet rule_set) {
+    gomoku::ChessBoardStateT<BOARD_SIZE> board;
+    SetupBenchBoard(&board, rule_set);
+    // 每100ms取一次结果：decision_n是着法最后一次改变时的模拟次数；
+    // 再记下搜索到1/4、1/2和结束时所选着法的胜率，看模拟次数增加后胜率是否已经稳定
+    std::cout << "rollout playouts/s decision_n rate@1/4 rate@1/2 rate@end move" << std::endl;
+    const std::pair<const char *, gomoku::RolloutPolicy> policies[] = {{"random",   gomoku::ROLLOUT_RANDOM},
+                                                                        {"local",    gomoku::ROLLOUT_LOCAL},
+                                                                        {"decisive", gomoku::ROLLOUT_DECISIVE}};
+    for (auto &policy: policies) {
+        gomoku::MCTSEngineT<BOARD_SIZE> engine(gomoku::FLAGS_thread_num);
+        if (!gomoku::ConfigureFromFlags(&engine)) {
+            return false;
+        }
+        engine.SetRolloutPolicy(policy.second);
+        engine.StartSearch(board, false);
+        gomoku::ChessMove move;
+        int64_t decision_n = 0;
+        const int samples = std::max(gomoku::FLAGS_think_time * 10, 4);
+        double rates[3] = {0, 0, 0};
+        for (int i = 1; i <= samples; i++) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+            double rate;
+            auto result = engine.GetResult(&rate);
+            if (!(result == move)) {
+                move = result;
+                decision_n = engine.GetRootN();
+            }
+            if (i == samples / 4) {
+                rates[0] = rate;
+            } else if (i == samples / 2) {
+                rates[1] = rate;
+            } else if (i == samples) {
+                rates[2] = rate;
+            }
+        }
+        engine.Stop();
+        std::cout << policy.first << " " << engine.GetRootN() * 10 / samples << " " << decision_n << " " << rates[0]
+                  << " " << rates[1] << " " << rates[2] << " " << move << std::endl;
+    }
+    return true;
+}
+
+template<int BOARD_SIZE>
+bool RestartPerformanceTest(gomoku::RuleSet rule_set) {
+    gomoku::ChessBoardStateT<BOARD_SIZE> board;
+    SetupBenchBoard(&board, rule_set);
+    // 连续搜索若干次，每次搜索20ms后停止。fresh：每次新建引擎，线程随引擎创建和退出，相当于每次搜索都新建线程；
+    // reuse：同一个引擎反复搜索，线程常驻；shared：每次新建引擎，但都用同一个外部常驻线程池。
+    // start_us是StartSearch本身的耗时，first_playout_us是到所有线程完成第一次模拟的耗时，stop_us是Stop的耗时，都取平均
+    const int rounds = 20;
+    common::ThreadPool pool;
+    pool.InitPersistent(gomoku::FLAGS_thread_num, gomoku::FLAGS_pin_threads);
+    pool.Start();
+    std::cout << "mode start_us first_playout_us stop_us" << std::endl;
+    for (const char *mode: {"fresh", "reuse", "shared"}) {
+        std::unique_ptr<gomoku::MCTSEngineT<BOARD_SIZE>> reused;
+        int64_t start_us = 0, first_playout_us = 0, stop_us = 0;
+        for (int i = 0; i < rounds; i++) {
+            std::unique_ptr<gomoku::MCTSEngineT<BOARD_SIZE>> owned;
+            if (std::string(mode) != "reuse" || reused == nullptr) {
+                owned.reset(new gomoku::MCTSEngineT<BOARD_SIZE>(gomoku::FLAGS_thread_num));
+                if (!gomoku::ConfigureFromFlags(owned.get())) {
+                    pool.Stop();
+                    return false;
+                }
+                if (std::string(mode) == "shared") {
+                    owned->SetThreadPool(&pool);
+                } else if (std::string(mode) == "reuse") {
+                    reused = std::move(owned);
+                }
+            }
+            auto engine = reused != nullptr ? reused.get() : owned.get();
+            auto start = common::TimeUtility::GetTimeofDayUs();
+            engine->StartSearch(board, false);
+            start_us += common::TimeUtility::GetTimeofDayUs() - start;
+            while (engine->GetFirstPlayoutUs() < 0) {
+                std::this_thread::sleep_for(std::chrono::microseconds(100));
+            }
+            first_playout_us += engine->GetFirstPlayoutUs();
+            std::this_thread::sleep_for(std::chrono::milliseconds(20));
+            start = common::TimeUtility::GetTimeofDayUs();
+            engine->Stop();
+            stop_us += common::TimeUtility::GetTimeofDayUs() - start;
+        }
+        std::cout << mode << " " << start_us / rounds << " " << first_playout_us / rounds << " " << stop_us / rounds
+                  << std::endl;
+    }
+    pool.Stop();
+    return true;
+}
+
+// 原update_is_end_from的逐格扫描实现，作为对照
+bool ScalarIsWinMove(const gomoku::ChessBoardState &board, const gomoku::ChessMove &move) {
+    const int dir[4][2] = {{1, 0},
+                           {0, 1},
+                           {1, 1},
+                           {1, -1}};
+    Chess chess = move.is_black ? BLACK : WHITE;
+    for (auto &d: dir) {
+        int cnt = 0;
+        for (int sign = -1; sign <= 1; sign += 2) {
+            int i = move.x + sign * d[0], j = move.y + sign * d[1];
+            while (i >= 0 && i < gomoku::BOARD_SIZE && j >= 0 && j < gomoku::BOARD_SIZE &&
+                   board.GetChessAt(i, j) == chess) {
+                cnt++;
+                i += sign * d[0];
+                j += sign * d[1];
+            }
+        }
+        if (cnt >= 4) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void WinCheckPerformanceTest() {
+    // 用随机对局生成局面，对每个局面的所有空点、两种颜色分别做五连判断
+    std::mt19937 rng(2024);
+    std::vector<gomoku::ChessBoardState> boards;
+    std::vector<gomoku::ChessMove> checks;
+    std::vector<int> board_index;
+    while (boards.size() < 2000) {
+        gomoku::ChessBoardState board;
+        bool is_black = true;
+        int stop_at = static_cast<int>(rng() % 60);
+        while (board.End() == BoardResult::NOT_END && board.GetMoveNums() < stop_at) {
+            auto move = board.getRandMove(is_black);
+            board.Move(move);
+            is_black = !is_black;
+        }
+        if (board.End() != BoardResult::NOT_END) {
+            continue;
+        }
+        std::vector<gomoku::ChessMove> moves;
+        board.GetMoves(true, &moves);
+        for (auto &move: moves) {
+            checks.emplace_back(true, move.x, move.y);
+            checks.emplace_back(false, move.x, move.y);
+            board_index.push_back(static_cast<int>(boards.size()));
+            board_index.push_back(static_cast<int>(boards.size()));
+        }
+        boards.push_back(board);
+    }
+    int64_t mismatch = 0;
+    for (size_t i = 0; i < checks.size(); i++) {
+        if (ScalarIsWinMove(boards[board_index[i]], checks[i]) != boards[board_index[i]].IsWinMove(checks[i])) {
+            mismatch++;
+        }
+    }
+    const int rounds = 20;
+    auto timeit = [&](const std::function<bool(const gomoku::ChessBoardState &, const gomoku::ChessMove &)> &f)
+            -> double {
+        int64_t wins = 0;
+        auto start = std::chrono::steady_clock::now();
+        for (int r = 0; r < rounds; r++) {
+            for (size_t i = 0; i < checks.size(); i++) {
+                wins += f(boards[board_index[i]], checks[i]);
+            }
+        }
+        auto end = std::chrono::steady_clock::now();
+        LOG(INFO) << "wins: " << wins;
+        return std::chrono::duration<double, std::nano>(end - start).count() / (rounds * checks.size());
+    };
+    double scalar_ns = timeit(ScalarIsWinMove);
+    double bitboard_ns = timeit([](const gomoku::ChessBoardState &board, const gomoku::ChessMove &move) -> bool {
+        return board.IsWinMove(move);
+    });
+    std::cout << "checks: " << checks.size() << " mismatch: " << mismatch << std::endl;
+    std::cout << "scalar: " << scalar_ns << " ns/check" << std::endl;
+    std::cout << "bitboard: " << bitboard_ns << " ns/check" << std::endl;
+    std::cout << "speedup: " << scalar_ns / bitboard_ns << "x" << std::endl;
+}
+
+int main(int argc, char *argv[]) {
+    // Initialize Google’s logging library.
+    gflags::ParseCommandLineFlags(&argc, &argv, false);
+    google::InitGoogleLogging("PerformanceTest");
+    FLAGS_log_dir = ".";
+    FLAGS_v = 2;
+
+    gomoku::RuleSet rule_set;
+    if (!gomoku::ParseRuleSet(gomoku::FLAGS_rule, &rule_set)) {
+        LOG(ERROR) << "unsupported rule: " << gomoku::FLAGS_rule;
+        return -1;
+    }
+    if (FLAGS_bench == "win_check") {
+        WinCheckPerformanceTest();
+        return 0;
+    }
+    //其余测试都按棋盘大小实例化，只在这里分派一次
+    bool ok = true;
+    if (!gomoku::WithBoardSize(gomoku::FLAGS_board_size, [rule_set, &ok](auto size) {
+        constexpr int board_size = decltype(size)::value;
+        if (FLAGS_bench == "transposition") {
+            ok = TranspositionPerformanceTest<board_size>(rule_set);
+        } else if (FLAGS_bench == "virtual_loss") {
+            ok = VirtualLossPerformanceTest<board_size>(rule_set);
+        } else if (FLAGS_bench == "parallel") {
+            ok = ParallelPerformanceTest<board_size>(rule_set);
+        } else if (FLAGS_bench == "rollout") {
+            ok = RolloutPerformanceTest<board_size>(rule_set);
+        } else if (FLAGS_bench == "restart") {
+            ok = RestartPerformanceTest<board_size>(rule_set);
+        } else {
+            ok = MCTSPerformanceTest<board_size>(rule_set);
+        }
+    })) {
+        LOG(ERROR) << "unsupported board_size: " << gomoku::FLAGS_board_size;
+        return -1;
+    }
+    return ok ? 0 : -1;
 }
@@ -0,0 +1,93 @@
+//
+// Created by zrr on 2024/3/16.
+//
+#include <stdint.h>
+#include <random>
+
+#ifndef GOMOKU_RANDOM_H
+#define GOMOKU_RANDOM_H
+namespace gomoku {
+    constexpr uint64_t SplitMix64(uint64_t *state) {
+        uint64_t z = (*state += 0x9E3779B97F4A7C15ULL);
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+        return z ^ (z >> 31);
+    }
+
+    /**
+     * xoshiro256**：32字节状态，每个数只要几次移位、异或和两次乘法，比minstd_rand的取模快，统计质量也更好。
+     * 满足UniformRandomBitGenerator，可以直接交给<random>和<algorithm>里的函数
+     */
+    class Xoshiro256 {
+    public:
+        using result_type = uint64_t;
+
+        constexpr Xoshiro256() : s_{0, 0, 0, 0} {} //全0状态只会输出0，用之前要先Seed
+
+        explicit Xoshiro256(uint64_t seed) : s_{0, 0, 0, 0} { Seed(seed); }
+
+        //用SplitMix64把种子展开成四个状态字，任何种子（包括0）都能用
+        void Seed(uint64_t seed) {
+            for (auto &word: s_) {
+                word = SplitMix64(&seed);
+            }
+        }
+
+        uint64_t operator()() {
+            const uint64_t result = Rotl(s_[1] * 5, 7) * 9;
+            const uint64_t t = s_[1] << 17;
+            s_[2] ^= s_[0];
+            s_[3] ^= s_[1];
+            s_[1] ^= s_[2];
+            s_[0] ^= s_[3];
+            s_[2] ^= t;
+            s_[3] = Rotl(s_[3], 45);
+            return result;
+        }
+
+        //[0, n)内的随机数：高32位乘n取高32位，不用除法，偏差不超过n/2^32
+        uint32_t Below(uint32_t n) {
+            return static_cast<uint32_t>(((*this)() >> 32) * n >> 32);
+        }
+
+        static constexpr result_type min() { return 0; }
+
+        static constexpr result_type max() { return UINT64_MAX; }
+
+    private:
+        uint64_t s_[4];
+
+        static uint64_t Rotl(uint64_t x, int k) { return (x << k) | (x >> (64 - k)); }
+    };
+
+    namespace detail {
+        //常量初始化的thread_local不需要每次访问都检查是否已构造，比带构造函数的快一倍
+        inline Xoshiro256 &ThreadRandomState() {
+            thread_local Xoshiro256 rng;
+            return rng;
+        }
+
+        inline bool &ThreadRandomSeeded() {
+            thread_local bool seeded = false;
+            return seeded;
+        }
+    }
+
+    inline void SeedThreadRandom(uint64_t seed) {
+        detail::ThreadRandomState().Seed(seed);
+        detail::ThreadRandomSeeded() = true;
+    }
+
+    /**
+     * 当前线程的随机数生成器，第一次使用时用random_device播种；需要复现时先用SeedThreadRandom给每个线程指定种子
+     */
+    inline Xoshiro256 &ThreadRandom() {
+        if (__builtin_expect(!detail::ThreadRandomSeeded(), 0)) {
+            std::random_device rd;
+            SeedThreadRandom(static_cast<uint64_t>(rd()) << 32 ^ rd());
+        }
+        return detail::ThreadRandomState();
+    }
+}
+
+#endif //GOMOKU_RANDOM_H
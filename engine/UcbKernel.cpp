@@ -0,0 +1,165 @@
+//
+// Created by zrr on 2024/3/14.
+//
+#include "UcbKernel.h"
+#include <cassert>
+#include <cmath>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define GOMOKU_UCB_X86
+#include <immintrin.h>
+#endif
+
+namespace gomoku {
+
+    namespace {
+        //向量实现读本地的快照：dn是n + virtual_loss，两个数组都按32字节对齐
+        typedef int (*SelectFunc)(const int64_t *, const int64_t *, int, double);
+
+        //各通道分别记下的最大值合并成一个，取值相同时取下标小的
+        int ReduceLanes(const double *value, const int64_t *index, int lanes) {
+            int best = -1;
+            double best_value = 0;
+            for (int i = 0; i < lanes; i++) {
+                if (index[i] < 0) {
+                    continue;
+                }
+                if (best == -1 || value[i] > best_value || (value[i] == best_value && index[i] < best)) {
+                    best = static_cast<int>(index[i]);
+                    best_value = value[i];
+                }
+            }
+            return best;
+        }
+
+#ifdef GOMOKU_UCB_X86
+        // [0, 2^52)内的整数转double：把整数放进尾数，指数取52，再减去2^52
+        const int64_t kMagicBits = 0x4330000000000000LL;
+        const double kMagic = 4503599627370496.0;
+
+        __attribute__((target("avx2")))
+        int SelectBestAvx2(const int64_t *dn_array, const int64_t *win, int num, double explore) {
+            const __m256d zero = _mm256_setzero_pd();
+            const __m256d explore_v = _mm256_set1_pd(explore);
+            const __m256i magic_bits = _mm256_set1_epi64x(kMagicBits);
+            const __m256d magic = _mm256_set1_pd(kMagic);
+            const __m256i step = _mm256_set1_epi64x(4);
+            __m256d best_value = _mm256_set1_pd(-INFINITY);
+            __m256i best_index = _mm256_set1_epi64x(-1);
+            __m256i index = _mm256_setr_epi64x(0, 1, 2, 3);
+            for (int i = 0; i < num; i += 4) {
+                __m256i dn = _mm256_load_si256(reinterpret_cast<const __m256i *>(dn_array + i));
+                __m256i w = _mm256_load_si256(reinterpret_cast<const __m256i *>(win + i));
+                __m256d d = _mm256_sub_pd(_mm256_castsi256_pd(_mm256_or_si256(dn, magic_bits)), magic);
+                __m256d wd = _mm256_sub_pd(_mm256_castsi256_pd(_mm256_or_si256(w, magic_bits)), magic);
+                __m256d value = _mm256_div_pd(_mm256_add_pd(wd, _mm256_mul_pd(explore_v, _mm256_sqrt_pd(d))), d);
+                __m256d better = _mm256_and_pd(_mm256_cmp_pd(d, zero, _CMP_GT_OQ),
+                                               _mm256_cmp_pd(value, best_value, _CMP_GT_OQ));
+                best_value = _mm256_blendv_pd(best_value, value, better);
+                best_index = _mm256_castpd_si256(_mm256_blendv_pd(_mm256_castsi256_pd(best_index),
+                                                                  _mm256_castsi256_pd(index), better));
+                index = _mm256_add_epi64(index, step);
+            }
+            alignas(32) double values[4];
+            alignas(32) int64_t indexes[4];
+            _mm256_store_pd(values, best_value);
+            _mm256_store_si256(reinterpret_cast<__m256i *>(indexes), best_index);
+            return ReduceLanes(values, indexes, 4);
+        }
+
+#ifdef __SSE2__
+
+        int SelectBestSse2(const int64_t *dn_array, const int64_t *win, int num, double explore) {
+            const __m128d zero = _mm_setzero_pd();
+            const __m128d explore_v = _mm_set1_pd(explore);
+            const __m128i magic_bits = _mm_set1_epi64x(kMagicBits);
+            const __m128d magic = _mm_set1_pd(kMagic);
+            const __m128i step = _mm_set1_epi64x(2);
+            __m128d best_value = _mm_set1_pd(-INFINITY);
+            __m128i best_index = _mm_set1_epi64x(-1);
+            __m128i index = _mm_set_epi64x(1, 0);
+            for (int i = 0; i < num; i += 2) {
+                __m128i dn = _mm_load_si128(reinterpret_cast<const __m128i *>(dn_array + i));
+                __m128i w = _mm_load_si128(reinterpret_cast<const __m128i *>(win + i));
+                __m128d d = _mm_sub_pd(_mm_castsi128_pd(_mm_or_si128(dn, magic_bits)), magic);
+                __m128d wd = _mm_sub_pd(_mm_castsi128_pd(_mm_or_si128(w, magic_bits)), magic);
+                __m128d value = _mm_div_pd(_mm_add_pd(wd, _mm_mul_pd(explore_v, _mm_sqrt_pd(d))), d);
+                __m128d better = _mm_and_pd(_mm_cmpgt_pd(d, zero), _mm_cmpgt_pd(value, best_value));
+                //SSE2没有blend，用与、与非、或拼出来
+                best_value = _mm_or_pd(_mm_and_pd(better, value), _mm_andnot_pd(better, best_value));
+                __m128i better_i = _mm_castpd_si128(better);
+                best_index = _mm_or_si128(_mm_and_si128(better_i, index), _mm_andnot_si128(better_i, best_index));
+                index = _mm_add_epi64(index, step);
+            }
+            alignas(16) double values[2];
+            alignas(16) int64_t indexes[2];
+            _mm_store_pd(values, best_value);
+            _mm_store_si128(reinterpret_cast<__m128i *>(indexes), best_index);
+            return ReduceLanes(values, indexes, 2);
+        }
+
+#endif
+#endif
+
+        struct Dispatch {
+            SelectFunc func; //为空时用SelectBestScalar，直接读原子数组
+            const char *isa;
+        };
+
+        const Dispatch &GetDispatch() {
+            static const Dispatch dispatch = []() -> Dispatch {
+#ifdef GOMOKU_UCB_X86
+                if (__builtin_cpu_supports("avx2")) {
+                    return {SelectBestAvx2, "avx2"};
+                }
+#ifdef __SSE2__
+                return {SelectBestSse2, "sse2"};
+#endif
+#endif
+                return {nullptr, "scalar"};
+            }();
+            return dispatch;
+        }
+    }
+
+    int UcbKernel::SelectBest(const std::atomic<int64_t> *n, const std::atomic<int64_t> *win,
+                              const std::atomic<int64_t> *virtual_loss, int num, double explore) {
+        const SelectFunc func = GetDispatch().func;
+        if (func == nullptr) {
+            return SelectBestScalar(n, win, virtual_loss, num, explore);
+        }
+        //向量实现按整组通道读到补齐的长度，补齐部分也要拷
+        const int padded = PaddedSize(num);
+        assert(padded <= MAX_NUM);
+        alignas(32) int64_t dn[MAX_NUM];
+        alignas(32) int64_t w[MAX_NUM];
+        for (int i = 0; i < padded; i++) {
+            dn[i] = n[i].load(std::memory_order_relaxed) + virtual_loss[i].load(std::memory_order_relaxed);
+            w[i] = win[i].load(std::memory_order_relaxed);
+        }
+        return func(dn, w, num, explore);
+    }
+
+    int UcbKernel::SelectBestScalar(const std::atomic<int64_t> *n, const std::atomic<int64_t> *win,
+                                    const std::atomic<int64_t> *virtual_loss, int num, double explore) {
+        int best = -1;
+        double best_value = 0;
+        for (int i = 0; i < num; i++) {
+            int64_t dn = n[i].load(std::memory_order_relaxed) + virtual_loss[i].load(std::memory_order_relaxed);
+            if (dn <= 0) {
+                continue;
+            }
+            double d = static_cast<double>(dn);
+            double value = (static_cast<double>(win[i].load(std::memory_order_relaxed)) + explore * std::sqrt(d)) / d;
+            if (best == -1 || value > best_value) {
+                best = i;
+                best_value = value;
+            }
+        }
+        return best;
+    }
+
+    const char *UcbKernel::Isa() {
+        return GetDispatch().isa;
+    }
+}
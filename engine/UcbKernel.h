@@ -0,0 +1,38 @@
+//
+// Created by zrr on 2024/3/14.
+//
+#include <atomic>
+#include <stdint.h>
+
+#ifndef GOMOKU_UCBKERNEL_H
+#define GOMOKU_UCBKERNEL_H
+namespace gomoku {
+    /**
+     * 批量计算子节点的UCB值并取最大值的下标。子节点统计按结构体数组存放：
+     * n是访问次数，win是走到该子节点的一方的胜局数，virtual_loss是正在经过该子节点的线程记下的虚拟败局，
+     * 三个数组长度都要补齐到LANES的倍数，补齐部分填0，各项都要小于2^52。
+     * 第i个子节点的值为 win/dn + explore/sqrt(dn)，按(win + explore*sqrt(dn))/dn只做一次除法，dn = n + virtual_loss，explore = C*sqrt(log(total_n))由调用方算好。
+     * dn为0的子节点（还没有发布或者还没有结果）不参与选择。取值相同时返回下标最小的，全部不参与时返回-1。
+     * 运行时按CPU支持的指令集选择AVX2、SSE2或者逐个计算的实现，三者结果完全一致。
+     * 统计可能正被其他线程fetch_add，都按relaxed原子读取：向量实现先把dn和win读到本地对齐的缓冲区里再计算，
+     * 各子节点的值不是同一时刻的快照
+     */
+    class UcbKernel {
+    public:
+        static const int LANES = 4;
+
+        static const int MAX_NUM = 400; //num的上限，即20路棋盘的格子数，已是LANES的倍数
+
+        static int PaddedSize(int num) { return (num + LANES - 1) / LANES * LANES; }
+
+        static int SelectBest(const std::atomic<int64_t> *n, const std::atomic<int64_t> *win,
+                              const std::atomic<int64_t> *virtual_loss, int num, double explore);
+
+        static int SelectBestScalar(const std::atomic<int64_t> *n, const std::atomic<int64_t> *win,
+                                    const std::atomic<int64_t> *virtual_loss, int num, double explore);
+
+        static const char *Isa(); //当前使用的实现："avx2"、"sse2"或"scalar"
+    };
+}
+
+#endif //GOMOKU_UCBKERNEL_H
@@ -22,12 +22,23 @@
 
 #include "common/thread_pool.h"
 
+#include <glog/logging.h>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
 
 namespace common {
 
 ThreadPool::ThreadPool()
     : numThreads_(-1),
-      starting_(false) {
+      starting_(false),
+      persistent_(false),
+      pinCpu_(false),
+      jobId_(0),
+      jobThreads_(0),
+      busyThreads_(0) {
 }
 
 ThreadPool::~ThreadPool() {
@@ -45,22 +56,124 @@ int ThreadPool::Init(int numThreads, std::function<void()> threadFunc) {
     return 0;
 }
 
+int ThreadPool::InitPersistent(int numThreads, bool pinCpu) {
+    if (0 >= numThreads) {
+        return -1;
+    }
+    numThreads_ = numThreads;
+    persistent_ = true;
+    pinCpu_ = pinCpu;
+    return 0;
+}
+
 void ThreadPool::Start() {
     if (!starting_.exchange(true, std::memory_order_acq_rel)) {
+        threads_.clear();
         threads_.reserve(numThreads_);
+        // Stop之前的任务已经执行过，新线程只执行之后Run的任务
+        uint64_t lastJob;
+        {
+            std::lock_guard<std::mutex> guard(jobMutex_);
+            lastJob = jobId_;
+        }
         for (int i = 0; i < numThreads_; ++i) {
-            threads_.emplace_back(new std::thread(threadFunc_));
+            if (persistent_) {
+                threads_.emplace_back(new std::thread(
+                    &ThreadPool::PersistentLoop, this, i, lastJob));
+            } else {
+                threads_.emplace_back(new std::thread(threadFunc_));
+            }
         }
     }
 }
 
 void ThreadPool::Stop() {
     if (starting_.exchange(false, std::memory_order_acq_rel)) {
+        if (persistent_) {
+            // 正在执行的任务要由调用方先让它返回，这里只唤醒休眠的线程退出
+            std::lock_guard<std::mutex> guard(jobMutex_);
+            jobCv_.notify_all();
+        }
         for (auto &thr : threads_) {
             thr->join();
         }
     }
 }
+
+uint64_t ThreadPool::Run(int numThreads, std::function<void()> func) {
+    std::unique_lock<std::mutex> lock(jobMutex_);
+    if (!persistent_ || !starting_.load() || numThreads <= 0 ||
+        numThreads > numThreads_) {
+        return 0;
+    }
+    doneCv_.wait(lock, [this] { return busyThreads_ == 0; });
+    job_ = std::move(func);
+    jobThreads_ = numThreads;
+    busyThreads_ = numThreads;
+    jobCv_.notify_all();
+    return ++jobId_;
+}
+
+void ThreadPool::Wait(uint64_t job) {
+    std::unique_lock<std::mutex> lock(jobMutex_);
+    doneCv_.wait(lock, [this, job] {
+        return job != jobId_ || busyThreads_ == 0;
+    });
+}
+
+void ThreadPool::PersistentLoop(int index, uint64_t seen) {
+    if (pinCpu_) {
+        PinCpu(index);
+    }
+    std::unique_lock<std::mutex> lock(jobMutex_);
+    while (true) {
+        jobCv_.wait(lock, [this, seen] {
+            return jobId_ != seen || !starting_.load();
+        });
+        if (!starting_.load()) {
+            return;
+        }
+        seen = jobId_;
+        if (index >= jobThreads_) {
+            continue;
+        }
+        // job_在所有线程返回之前不会被下一次Run替换
+        lock.unlock();
+        job_();
+        lock.lock();
+        if (--busyThreads_ == 0) {
+            doneCv_.notify_all();
+        }
+    }
+}
+
+void ThreadPool::PinCpu(int index) {
+#ifdef __linux__
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    if (pthread_getaffinity_np(pthread_self(), sizeof(allowed), &allowed) != 0 ||
+        CPU_COUNT(&allowed) == 0) {
+        LOG(WARNING) << "get thread affinity failed, thread " << index
+                     << " is not pinned";
+        return;
+    }
+    int target = index % CPU_COUNT(&allowed);
+    for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+        if (!CPU_ISSET(cpu, &allowed) || target-- > 0) {
+            continue;
+        }
+        cpu_set_t pinned;
+        CPU_ZERO(&pinned);
+        CPU_SET(cpu, &pinned);
+        if (pthread_setaffinity_np(pthread_self(), sizeof(pinned),
+                                   &pinned) != 0) {
+            LOG(WARNING) << "pin thread " << index << " to cpu " << cpu
+                         << " failed";
+        }
+        return;
+    }
+#endif
+}
 int ThreadPool::NumOfThreads() {
     return numThreads_;
 }
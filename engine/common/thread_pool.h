@@ -29,6 +29,8 @@
 #include <mutex>    //NOLINT
 #include <atomic>
 #include <memory>
+#include <condition_variable>
+#include <stdint.h>
 
 #include "common/uncopyable.h"
 
@@ -41,15 +43,43 @@ class ThreadPool : public Uncopyable {
     ~ThreadPool();
 
     int Init(int numThreads, std::function<void()> func);
+    /**
+     * 常驻模式：Start时创建numThreads个线程，之后一直保留到Stop，没有任务时停在条件变量上。
+     * 用Run把任务交给其中若干个线程执行，多次搜索可以共用同一批线程，也可以由多个引擎共用
+     * @param pinCpu 为true时第i个线程绑定到当前可用的第i个CPU上（按可用CPU数取模），只在linux下生效
+     */
+    int InitPersistent(int numThreads, bool pinCpu = false);
     void Start();
     void Stop();
     int NumOfThreads();
 
+    /**
+     * 常驻模式下让前numThreads个线程各执行一次func，不等待执行完就返回。同一时间只执行一个任务，
+     * 上一个任务还没结束时先等它结束
+     * @return 任务编号，用于Wait；没有Start或者线程数不够时返回0
+     */
+    uint64_t Run(int numThreads, std::function<void()> func);
+    // 等编号为job的任务在所有线程上都返回，线程回到休眠；已经结束的任务立即返回
+    void Wait(uint64_t job);
+
  private:
     std::vector<std::unique_ptr<std::thread>> threads_;
     int numThreads_;
     std::function<void()> threadFunc_;
     std::atomic<bool> starting_;
+
+    bool persistent_;
+    bool pinCpu_;
+    std::mutex jobMutex_;  // 保护下面的任务状态
+    std::condition_variable jobCv_;
+    std::condition_variable doneCv_;
+    std::function<void()> job_;
+    uint64_t jobId_;  // 最近一次Run的编号，从1开始
+    int jobThreads_;
+    int busyThreads_;  // 还在执行当前任务的线程数
+
+    void PersistentLoop(int index, uint64_t seen);  // seen是启动前最后一个任务的编号
+    void PinCpu(int index);
 };
 
 }  // namespace common
@@ -2,8 +2,57 @@
 // Created by zhengran on 2024/3/1.
 //
 #include "gflags/gflags.h"
+#include "glog/logging.h"
 #include "common_flags.h"
+#include "MCTSEngine.h"
 namespace gomoku {
     DEFINE_int32(thread_num, 1, "");
+    DEFINE_int32(virtual_loss, 1, "多线程搜索时线程经过节点记下的虚拟败局数，0表示关闭");
     DEFINE_int32(think_time, 1, "");
+    DEFINE_int32(board_size, 15, "棋盘大小，支持15、19、20");
+    DEFINE_string(rule, "freestyle", "规则，freestyle：无禁手，renju：黑棋禁手");
+    DEFINE_bool(huge_pages, false, "蒙特卡洛搜索树的节点内存池是否使用透明大页");
+    DEFINE_bool(transposition, false, "蒙特卡洛搜索是否按局面哈希合并置换局面的节点");
+    DEFINE_string(parallel, "tree", "多线程搜索方式，tree：所有线程共享一棵树，root：每个线程一棵私有树，定期合并统计");
+    DEFINE_int32(share_plies, 1, "root并行时各线程共享统计的层数，0表示只合并根节点的子节点");
+    DEFINE_int32(leaf_playouts, 1, "每展开一个新叶子从它模拟的局数，汇总后只回溯一次");
+    DEFINE_string(rollout, "random", "模拟的走子策略，random：随机，local：只在已有棋子附近随机，decisive：优先成五和堵对方的五");
+    DEFINE_uint64(seed, 0, "非0时第i个搜索线程用seed+i作为随机数种子，0表示随机播种");
+    DEFINE_bool(pin_threads, false, "搜索线程是否绑定到各自的CPU上");
+
+    template<int BOARD_SIZE>
+    bool ConfigureFromFlags(MCTSEngineT<BOARD_SIZE> *engine) {
+        RuleSet rule_set;
+        if (!ParseRuleSet(FLAGS_rule, &rule_set)) {
+            LOG(ERROR) << "unsupported rule: " << FLAGS_rule;
+            return false;
+        }
+        ParallelMode parallel_mode;
+        if (!ParseParallelMode(FLAGS_parallel, &parallel_mode)) {
+            LOG(ERROR) << "unsupported parallel: " << FLAGS_parallel;
+            return false;
+        }
+        RolloutPolicy rollout_policy;
+        if (!ParseRolloutPolicy(FLAGS_rollout, &rollout_policy)) {
+            LOG(ERROR) << "unsupported rollout: " << FLAGS_rollout;
+            return false;
+        }
+        engine->SetRuleSet(rule_set);
+        engine->SetHugePages(FLAGS_huge_pages);
+        engine->SetVirtualLoss(FLAGS_virtual_loss);
+        engine->SetTransposition(FLAGS_transposition);
+        engine->SetParallelMode(parallel_mode);
+        engine->SetSharePlies(FLAGS_share_plies);
+        engine->SetLeafPlayouts(FLAGS_leaf_playouts);
+        engine->SetRolloutPolicy(rollout_policy);
+        engine->SetSeed(FLAGS_seed);
+        engine->SetPinThreads(FLAGS_pin_threads);
+        return true;
+    }
+
+    template bool ConfigureFromFlags(MCTSEngineT<15> *engine);
+
+    template bool ConfigureFromFlags(MCTSEngineT<19> *engine);
+
+    template bool ConfigureFromFlags(MCTSEngineT<20> *engine);
 }
\ No newline at end of file
@@ -6,6 +6,27 @@
 #define GOMOKU_FLAGS_H
 namespace gomoku {
     DECLARE_int32(thread_num);
+    DECLARE_int32(virtual_loss);
     DECLARE_int32(think_time);
+    DECLARE_int32(board_size);
+    DECLARE_string(rule);
+    DECLARE_bool(huge_pages);
+    DECLARE_bool(transposition);
+    DECLARE_string(parallel);
+    DECLARE_int32(share_plies);
+    DECLARE_int32(leaf_playouts);
+    DECLARE_string(rollout);
+    DECLARE_uint64(seed);
+    DECLARE_bool(pin_threads);
+
+    template<int BOARD_SIZE>
+    class MCTSEngineT;
+
+    /**
+     * 按命令行参数设置引擎的规则、并行方式、走子策略等全部搜索选项，各个程序都通过它配置引擎，
+     * 单项测试在它之后再覆盖要对比的选项。rule、parallel、rollout不认识时返回false
+     */
+    template<int BOARD_SIZE>
+    bool ConfigureFromFlags(MCTSEngineT<BOARD_SIZE> *engine);
 }
 #endif //GOMOKU_FLAGS_H
@@ -60,13 +60,19 @@ void test2(gomoku::ChessBoardState *board, bool *black_first) {
 
 }
 
-void test3(gomoku::ChessBoardState *board, bool *black_first) {
+template<int BOARD_SIZE>
+void test3(gomoku::ChessBoardStateT<BOARD_SIZE> *board, bool *black_first) {
     *black_first = true;
 }
 
-void Deduction(gomoku::ChessBoardState board, bool black) {
+template<int BOARD_SIZE>
+bool Deduction(gomoku::ChessBoardStateT<BOARD_SIZE> board, bool black) {
     board.PrintOnTerminal();
-    gomoku::MCTSEngine engine(gomoku::FLAGS_thread_num);
+    gomoku::MCTSEngineT<BOARD_SIZE> engine(gomoku::FLAGS_thread_num);
+    if (!gomoku::ConfigureFromFlags(&engine)) {
+        return false;
+    }
+    engine.SetRuleSet(board.GetRuleSet());
     engine.StartSearch(board, black);
     int step = 1;
     while (board.End() == BoardResult::NOT_END) {
@@ -84,6 +90,7 @@ void Deduction(gomoku::ChessBoardState board, bool black) {
         step++;
     }
     engine.Stop();
+    return true;
 }
 
 int main(int argc, char *argv[]) {
@@ -92,10 +99,23 @@ int main(int argc, char *argv[]) {
     google::InitGoogleLogging("gomoku");
     FLAGS_log_dir = ".";
     FLAGS_v = 2;
-    gomoku::ChessBoardState board;
-    bool black;
-    test3(&board, &black);
-    Deduction(board, black);
+    gomoku::RuleSet rule_set;
+    if (!gomoku::ParseRuleSet(gomoku::FLAGS_rule, &rule_set)) {
+        LOG(ERROR) << "unsupported rule: " << gomoku::FLAGS_rule;
+        return -1;
+    }
+    bool ok = true;
+    if (!gomoku::WithBoardSize(gomoku::FLAGS_board_size, [rule_set, &ok](auto size) {
+        gomoku::ChessBoardStateT<decltype(size)::value> board;
+        board.SetRuleSet(rule_set);
+        bool black;
+        test3(&board, &black);
+        ok = Deduction(board, black);
+    })) {
+        LOG(ERROR) << "unsupported board_size: " << gomoku::FLAGS_board_size;
+        return -1;
+    }
+    return ok ? 0 : -1;
 }
 
 //